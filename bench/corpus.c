@@ -0,0 +1,94 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "corpus.h"
+
+#define NUM_VARS 8
+
+// xorshift32, so the corpus is the same on every platform.
+static uint32_t next(uint32_t *seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+static uint32_t below(uint32_t *seed, uint32_t n) { return next(seed) % n; }
+
+static void expr(FILE *f, uint32_t *seed, size_t depth) {
+    static const char *binops[] = {"+", "-", "*", "/", "==", "!=", "<", "<=",
+                                   ">", ">="};
+
+    if (depth == 0 || below(seed, 3) == 0) {
+        if (below(seed, 2)) {
+            fprintf(f, "v%u", below(seed, NUM_VARS));
+        } else {
+            fprintf(f, "%u", below(seed, 1000));
+        }
+        return;
+    }
+
+    expr(f, seed, depth - 1);
+    fprintf(f, " %s ", binops[below(seed, sizeof(binops) / sizeof(*binops))]);
+    expr(f, seed, depth - 1);
+}
+
+static void statement(FILE *f, uint32_t *seed, size_t indent, size_t depth) {
+    static const char *assignops[] = {"=", "+=", "-=", "*=", "/="};
+
+    fprintf(f, "%*s", (int)indent * 4, "");
+
+    if (depth > 0 && below(seed, 4) == 0) {
+        fprintf(f, "if (");
+        expr(f, seed, 2);
+        fprintf(f, ") {\n");
+        statement(f, seed, indent + 1, depth - 1);
+        statement(f, seed, indent + 1, depth - 1);
+        fprintf(f, "%*s} else {\n", (int)indent * 4, "");
+        statement(f, seed, indent + 1, depth - 1);
+        fprintf(f, "%*s}\n", (int)indent * 4, "");
+        return;
+    }
+
+    fprintf(f, "v%u %s ", below(seed, NUM_VARS),
+            assignops[below(seed, sizeof(assignops) / sizeof(*assignops))]);
+    expr(f, seed, 3);
+    fprintf(f, ";\n");
+}
+
+static void function(FILE *f, uint32_t *seed, size_t n) {
+    fprintf(f, "int function_%zu() {\n", n);
+
+    for (size_t i = 0; i < NUM_VARS; i++) {
+        fprintf(f, "    %s v%zu = %u;\n", below(seed, 2) ? "int" : "long", i,
+                below(seed, 100));
+    }
+    fprintf(f, "    struct point { int x; long y; } p;\n");
+
+    size_t statements = 4 + below(seed, 12);
+    for (size_t i = 0; i < statements; i++) {
+        statement(f, seed, 1, 2);
+    }
+
+    fprintf(f, "    return ");
+    expr(f, seed, 2);
+    fprintf(f, ";\n}\n\n");
+}
+
+char *corpus_generate(size_t size, size_t *len) {
+    char *buf = NULL;
+    size_t buf_len = 0;
+    FILE *f = open_memstream(&buf, &buf_len);
+
+    uint32_t seed = 0x9e3779b9;
+    for (size_t n = 0; (size_t)ftell(f) < size; n++) {
+        function(f, &seed, n);
+    }
+    fprintf(f, "int main() {\n    return 0;\n}\n");
+
+    fclose(f);
+    *len = buf_len;
+    return buf;
+}
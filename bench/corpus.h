@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stddef.h>
+
+// Generates a deterministic, valid program of at least size bytes, made of
+// many small functions in the subset of C that ycc supports. The result is
+// NUL-terminated and must be freed by the caller.
+char *corpus_generate(size_t size, size_t *len);
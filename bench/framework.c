@@ -0,0 +1,123 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "framework.h"
+
+#define MIN_SECONDS 1.0
+#define MIN_ITERATIONS 3
+#define NAME_PADDING 40
+
+extern struct bench __start_benches;
+extern struct bench __stop_benches;
+
+struct bench_state {
+    struct bench *bench;
+
+    char variant[64];
+    size_t bytes;
+
+    size_t iterations;
+    double start;
+    // Result of the last completed loop:
+    double seconds_per_iteration;
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_result(struct bench_state *b, double elapsed) {
+    char name[128];
+    if (b->variant[0] != '\0') {
+        snprintf(name, sizeof(name), "%s/%s", b->bench->name, b->variant);
+    } else {
+        snprintf(name, sizeof(name), "%s", b->bench->name);
+    }
+
+    printf("\t%-*s %12.0f ns/iter", NAME_PADDING, name,
+           b->seconds_per_iteration * 1e9);
+    if (b->bytes > 0) {
+        double mb = (double)b->bytes * b->iterations / (1024 * 1024);
+        printf(" %10.1f MB/s", mb / elapsed);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+bool bench_loop(struct bench_state *b) {
+    // Timing every iteration is cheap next to the work being measured, and
+    // avoids having to guess an iteration count up front.
+    double t = now();
+
+    if (b->iterations == 0) {
+        b->start = t;
+    } else {
+        double elapsed = t - b->start;
+        if (elapsed >= MIN_SECONDS && b->iterations >= MIN_ITERATIONS) {
+            b->seconds_per_iteration = elapsed / b->iterations;
+            print_result(b, elapsed);
+
+            b->iterations = 0;
+            b->variant[0] = '\0';
+            return false;
+        }
+    }
+
+    b->iterations++;
+    return true;
+}
+
+void bench_set_bytes(struct bench_state *b, size_t bytes) { b->bytes = bytes; }
+
+void bench_variant(struct bench_state *b, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(b->variant, sizeof(b->variant), fmt, args);
+    va_end(args);
+}
+
+double bench_seconds(struct bench_state *b) {
+    return b->seconds_per_iteration;
+}
+
+// Runs a benchmark if its name contains any of the filters, or if there are
+// no filters.
+static bool selected(struct bench *bench, int argc, char **argv) {
+    if (argc < 2) {
+        return true;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strstr(bench->name, argv[i]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    const char *file = NULL;
+    for (struct bench *bench = &__start_benches; bench < &__stop_benches;
+         bench++) {
+        if (!selected(bench, argc, argv)) {
+            continue;
+        }
+
+        // Assumes benchmarks for the same file will be placed next to each
+        // other in memory.
+        if (file == NULL || strcmp(file, bench->file)) {
+            file = bench->file;
+            printf("running %s:\n", file);
+        }
+
+        struct bench_state b = {.bench = bench};
+        bench->fn(&b);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Benchmarks are declared like tests, with BENCH(name) { ... }. The body sets
+// up its input and then times its hot loop with bench_loop():
+//
+//     BENCH(lex) {
+//         ... setup, not timed ...
+//         bench_set_bytes(b, len);
+//         while (bench_loop(b)) {
+//             ... timed ...
+//         }
+//     }
+//
+// A benchmark may time several variants (e.g. thread counts) by calling
+// bench_variant() before each loop.
+//
+// The runner walks the "benches" section as an array, so the entries must
+// not be given any more alignment than the struct itself needs.
+
+struct bench_state;
+
+struct bench {
+    const char *file;
+    const char *name;
+    void (*fn)(struct bench_state *b);
+};
+
+#define BENCH(identifier)                                                      \
+    void bench_fn_##identifier(struct bench_state *b);                         \
+    struct bench bench_##identifier                                            \
+        __attribute__((__section__("benches"), __aligned__(8))) = {            \
+            .file = __FILE__,                                                  \
+            .name = #identifier,                                               \
+            .fn = &bench_fn_##identifier,                                      \
+    };                                                                         \
+    void bench_fn_##identifier(struct bench_state *b)
+
+// Returns true until the loop has run for long enough to give a stable
+// measurement, then prints the result and returns false. Only time spent
+// inside the loop is measured.
+bool bench_loop(struct bench_state *b);
+
+// Number of input bytes processed by each iteration, to report throughput.
+void bench_set_bytes(struct bench_state *b, size_t bytes);
+
+// Labels the next loop's result, for benchmarks that time several variants.
+void bench_variant(struct bench_state *b, const char *fmt, ...);
+
+// Seconds per iteration of the most recently completed loop.
+double bench_seconds(struct bench_state *b);
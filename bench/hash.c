@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ident.h"
+#include "lexer.h"
+#include "map.h"
+#include "map_define.h"
+
+#include "corpus.h"
+#include "framework.h"
+
+#define WORDS (64 * 1024)
+#define CORPUS_SIZE (4 * 1024 * 1024)
+
+// Identifier-like strings, of the lengths that real programs use.
+struct words {
+    char (*str)[40];
+    size_t *len;
+    size_t bytes;
+};
+
+static struct words make_words(void) {
+    static const char *formats[] = {"i%zu", "tmp_%zx", "node_count_%zu",
+                                    "generated_intermediate_value_%zu"};
+    struct words words = {
+        .str = malloc(WORDS * sizeof(*words.str)),
+        .len = malloc(WORDS * sizeof(size_t)),
+    };
+    for (size_t i = 0; i < WORDS; i++) {
+        words.len[i] = snprintf(words.str[i], sizeof(*words.str),
+                                formats[i % 4], i);
+        words.bytes += words.len[i];
+    }
+    return words;
+}
+
+static void free_words(struct words *words) {
+    free(words->str);
+    free(words->len);
+}
+
+static void print_stats(const char *name, struct map_stats stats) {
+    printf("\t    %s: %zu keys in %zu slots, mean probe %.3f, max probe %zu\n",
+           name, stats.count, stats.capacity, stats.mean_probe,
+           stats.max_probe);
+}
+
+// Throughput of hashing identifiers.
+BENCH(hash_string) {
+    struct words words = make_words();
+    volatile uint32_t sink = 0;
+    bench_set_bytes(b, words.bytes);
+
+    bench_variant(b, "fnv");
+    while (bench_loop(b)) {
+        for (size_t i = 0; i < WORDS; i++) {
+            sink ^= map_hash_bytes_fnv(words.str[i], words.len[i]);
+        }
+    }
+
+    bench_variant(b, "wyhash");
+    while (bench_loop(b)) {
+        for (size_t i = 0; i < WORDS; i++) {
+            sink ^= map_hash_bytes(words.str[i], words.len[i]);
+        }
+    }
+
+    free_words(&words);
+}
+
+struct strn {
+    const char *str;
+    size_t len;
+};
+
+static bool strn_eq(struct strn a, struct strn b) {
+    return a.len == b.len && memcmp(a.str, b.str, a.len) == 0;
+}
+
+static uint32_t strn_hash_fnv(struct strn s) {
+    return map_hash_bytes_fnv(s.str, s.len);
+}
+
+static uint32_t strn_hash(struct strn s) {
+    return map_hash_bytes(s.str, s.len);
+}
+
+MAP_DEFINE(fnv_string_map, struct strn, uint32_t, strn_hash_fnv, strn_eq)
+MAP_DEFINE(string_map, struct strn, uint32_t, strn_hash, strn_eq)
+
+// Interning identifiers, as the ident table does: a lookup for every
+// occurrence, hashed over an explicit length. Probe lengths are printed for
+// each hash, and for the ident table after lexing a corpus.
+BENCH(hash_ident_table) {
+    struct words words = make_words();
+    bench_set_bytes(b, words.bytes);
+
+#define INTERN_ALL(NAME)                                                       \
+    do {                                                                       \
+        bench_variant(b, #NAME);                                               \
+        struct NAME m = {0};                                                   \
+        while (bench_loop(b)) {                                                \
+            NAME##_free(&m);                                                   \
+            for (size_t i = 0; i < WORDS; i++) {                               \
+                struct strn s = {words.str[i], words.len[i]};                  \
+                NAME##_insert(&m, s, i);                                       \
+            }                                                                  \
+        }                                                                      \
+        print_stats("probes", NAME##_stats(&m));                               \
+        NAME##_free(&m);                                                       \
+    } while (0)
+
+    INTERN_ALL(fnv_string_map);
+    INTERN_ALL(string_map);
+
+#undef INTERN_ALL
+
+    size_t len;
+    char *prog = corpus_generate(CORPUS_SIZE, &len);
+    struct ident_table *idents = ident_table_new();
+    lexer_state_t state = lexer_new(idents, prog, len);
+    token_t token;
+    while (lexer_next_token(&state, &token)) {
+    }
+    print_stats("ident table after lexing corpus", ident_table_stats(idents));
+    ident_table_free(idents);
+    free(prog);
+
+    free_words(&words);
+}
+
+MAP_DEFINE(fnv_ptr_map, struct ident *, size_t, map_hash_ptr_fnv, map_eq_ptr)
+MAP_DEFINE(ptr_map, struct ident *, size_t, map_hash_ptr, map_eq_ptr)
+
+// Lookups keyed by ident pointers, as scopes do. The idents are laid out
+// next to each other by the ident table, so their addresses only differ in a
+// few low bits.
+BENCH(hash_scope) {
+    struct words words = make_words();
+    struct ident_table *idents = ident_table_new();
+    struct ident **keys = malloc(WORDS * sizeof(struct ident *));
+    for (size_t i = 0; i < WORDS; i++) {
+        keys[i] = ident_from_strn(idents, words.str[i], words.len[i],
+                                  ident_hash(words.str[i], words.len[i]));
+    }
+
+    volatile size_t sink = 0;
+
+#define LOOKUP_ALL(NAME)                                                       \
+    do {                                                                       \
+        struct NAME m = {0};                                                   \
+        for (size_t i = 0; i < WORDS; i++) {                                   \
+            NAME##_insert(&m, keys[i], i);                                     \
+        }                                                                      \
+        bench_variant(b, #NAME);                                               \
+        while (bench_loop(b)) {                                                \
+            for (size_t i = 0; i < WORDS; i++) {                               \
+                sink += *NAME##_get(&m, keys[i]);                              \
+            }                                                                  \
+        }                                                                      \
+        print_stats("probes", NAME##_stats(&m));                               \
+        NAME##_free(&m);                                                       \
+    } while (0)
+
+    LOOKUP_ALL(fnv_ptr_map);
+    LOOKUP_ALL(ptr_map);
+
+#undef LOOKUP_ALL
+
+    free(keys);
+    ident_table_free(idents);
+    free_words(&words);
+}
@@ -0,0 +1,107 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ident.h"
+
+#include "framework.h"
+
+#define WORDS (64 * 1024)
+#define MAX_THREADS 64
+
+struct words {
+    char (*str)[16];
+    size_t *len;
+    uint32_t *hash;
+    size_t n;
+    size_t bytes;
+};
+
+static struct words make_words(void) {
+    struct words words = {
+        .str = malloc(WORDS * sizeof(*words.str)),
+        .len = malloc(WORDS * sizeof(size_t)),
+        .hash = malloc(WORDS * sizeof(uint32_t)),
+        .n = WORDS,
+    };
+    for (size_t i = 0; i < WORDS; i++) {
+        words.len[i] = snprintf(words.str[i], sizeof(*words.str), "ident_%zx",
+                                i * 2654435761u % WORDS);
+        words.hash[i] = ident_hash(words.str[i], words.len[i]);
+        words.bytes += words.len[i];
+    }
+    return words;
+}
+
+static void free_words(struct words *words) {
+    free(words->str);
+    free(words->len);
+    free(words->hash);
+}
+
+// Every thread interns the same words, each starting from a different place,
+// so that threads both race to insert and look up each other's idents.
+struct worker {
+    struct ident_table *idents;
+    struct words *words;
+    size_t start;
+};
+
+static void *intern_words(void *data) {
+    struct worker *w = data;
+    struct words *words = w->words;
+    for (size_t i = 0; i < words->n; i++) {
+        size_t j = (w->start + i) % words->n;
+        ident_from_strn(w->idents, words->str[j], words->len[j],
+                        words->hash[j]);
+    }
+    return NULL;
+}
+
+// Interning distinct words into a fresh table, on one thread.
+BENCH(intern) {
+    struct words words = make_words();
+
+    bench_set_bytes(b, words.bytes);
+    while (bench_loop(b)) {
+        struct ident_table *idents = ident_table_new();
+        struct worker worker = {.idents = idents, .words = &words};
+        intern_words(&worker);
+        ident_table_free(idents);
+    }
+
+    free_words(&words);
+}
+
+// Interning the same words from 1 to 64 threads at once, into a fresh table
+// each iteration. Throughput counts every thread's bytes, so on enough cores
+// it only stops scaling when threads contend for the table.
+BENCH(intern_contention) {
+    struct words words = make_words();
+
+    for (size_t nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        struct worker workers[MAX_THREADS];
+        pthread_t threads[MAX_THREADS];
+
+        bench_set_bytes(b, words.bytes * nthreads);
+        bench_variant(b, "threads=%zu", nthreads);
+        while (bench_loop(b)) {
+            struct ident_table *idents = ident_table_new();
+            for (size_t i = 0; i < nthreads; i++) {
+                workers[i] = (struct worker){
+                    .idents = idents,
+                    .words = &words,
+                    .start = WORDS / nthreads * i,
+                };
+                pthread_create(&threads[i], NULL, intern_words, &workers[i]);
+            }
+            for (size_t i = 0; i < nthreads; i++) {
+                pthread_join(threads[i], NULL);
+            }
+            ident_table_free(idents);
+        }
+    }
+
+    free_words(&words);
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ident.h"
+#include "lexer.h"
+#include "scan.h"
+#include "tokens.h"
+
+#include "corpus.h"
+#include "framework.h"
+
+#define CORPUS_SIZE (16 * 1024 * 1024)
+
+static const struct scan_kernels *kernels[] = {
+    &scan_kernels_scalar,
+#if defined(SCAN_X86)
+    &scan_kernels_sse2,
+    &scan_kernels_avx2,
+#endif
+};
+
+static void lex_with_each_kernel(struct bench_state *b,
+                                 struct ident_table *idents, const char *prog,
+                                 size_t len) {
+    bench_set_bytes(b, len);
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+#if defined(SCAN_X86)
+        if (kernels[i] == &scan_kernels_avx2 &&
+            !__builtin_cpu_supports("avx2")) {
+            continue;
+        }
+#endif
+
+        bench_variant(b, "%s", kernels[i]->name);
+        while (bench_loop(b)) {
+            lexer_state_t state = lexer_new(idents, prog, len);
+            state.scan = kernels[i];
+            token_t token;
+            while (lexer_next_token(&state, &token)) {
+            }
+        }
+    }
+}
+
+// Throughput of lexing a large file, with each set of scanning kernels.
+// Identifiers are interned, so after the first iteration this measures the
+// table lookups rather than insertions.
+BENCH(lex) {
+    size_t len;
+    char *prog = corpus_generate(CORPUS_SIZE, &len);
+    struct ident_table *idents = ident_table_new();
+
+    lex_with_each_kernel(b, idents, prog, len);
+
+    ident_table_free(idents);
+    free(prog);
+}
+
+// Generated code tends to be deeply indented, with long names and comments,
+// which is where the vector kernels pay off.
+BENCH(lex_long_runs) {
+    char *prog = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&prog, &len);
+    for (size_t i = 0; (size_t)ftell(f) < CORPUS_SIZE; i++) {
+        fprintf(f,
+                "%24s/* generated from node %zu of the input graph */\n"
+                "%24sgenerated_intermediate_value_%zu = "
+                "generated_intermediate_value_%zu * 1000000007;\n",
+                "", i, "", i % 512, (i + 1) % 512);
+    }
+    fclose(f);
+
+    struct ident_table *idents = ident_table_new();
+
+    lex_with_each_kernel(b, idents, prog, len);
+
+    ident_table_free(idents);
+    free(prog);
+}
+
+// Lexing a large file on several threads, against lexing it serially.
+BENCH(lex_parallel) {
+    size_t len;
+    char *prog = corpus_generate(CORPUS_SIZE, &len);
+    struct ident_table *idents = ident_table_new();
+    bench_set_bytes(b, len);
+
+    bench_variant(b, "serial");
+    while (bench_loop(b)) {
+        tokens_free(tokens_lex(idents, prog, len));
+    }
+    double serial = bench_seconds(b);
+
+    static const size_t threads[] = {2, 4, 8};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        bench_variant(b, "threads=%zu", threads[i]);
+        while (bench_loop(b)) {
+            tokens_free(tokens_lex_parallel(idents, prog, len, threads[i]));
+        }
+        printf("\t    speedup: %.2fx\n", serial / bench_seconds(b));
+    }
+
+    ident_table_free(idents);
+    free(prog);
+}
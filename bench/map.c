@@ -0,0 +1,43 @@
+#include <stdlib.h>
+
+#include "map.h"
+#include "map_define.h"
+
+#include "framework.h"
+
+#define KEYS (64 * 1024)
+
+MAP_DEFINE(bench_map, const char *, size_t, map_hash_ptr, map_eq_ptr)
+
+// KEYS lookups of pointer keys (like scopes and struct member lookups),
+// through struct map's function pointers and through a MAP_DEFINE map.
+BENCH(map_pointer_lookup) {
+    char *keys = malloc(KEYS);
+
+    struct map *m = map_new(map_key_pointer);
+    struct bench_map typed = {0};
+    for (size_t i = 0; i < KEYS; i++) {
+        map_insert(m, &keys[i], &keys[i]);
+        bench_map_insert(&typed, &keys[i], i);
+    }
+
+    volatile size_t sink = 0;
+
+    bench_variant(b, "map");
+    while (bench_loop(b)) {
+        for (size_t i = 0; i < KEYS; i++) {
+            sink += (char *)map_get(m, &keys[i]) - keys;
+        }
+    }
+
+    bench_variant(b, "MAP_DEFINE");
+    while (bench_loop(b)) {
+        for (size_t i = 0; i < KEYS; i++) {
+            sink += *bench_map_get(&typed, &keys[i]);
+        }
+    }
+
+    bench_map_free(&typed);
+    map_free(m);
+    free(keys);
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "ident.h"
+#include "parser.h"
+#include "tokens.h"
+
+#include "corpus.h"
+#include "framework.h"
+
+#define CORPUS_SIZE (16 * 1024 * 1024)
+
+// The lex and parse phases separately, and then together.
+BENCH(parse) {
+    size_t len;
+    char *prog = corpus_generate(CORPUS_SIZE, &len);
+    struct ident_table *idents = ident_table_new();
+    bench_set_bytes(b, len);
+
+    bench_variant(b, "lex");
+    while (bench_loop(b)) {
+        tokens_free(tokens_lex(idents, prog, len));
+    }
+
+    struct tokens *tokens = tokens_lex(idents, prog, len);
+    bench_variant(b, "parse");
+    while (bench_loop(b)) {
+        ast_program_t program;
+        parser_parse_tokens(idents, prog, tokens, NULL, &program);
+        ast_program_free(&program);
+    }
+    tokens_free(tokens);
+
+    bench_variant(b, "lex+parse");
+    while (bench_loop(b)) {
+        ast_program_t program;
+        parser_parse(idents, prog, len, &program);
+        ast_program_free(&program);
+    }
+
+    ident_table_free(idents);
+    free(prog);
+}
+
+// Functions made of long expressions, mixing every tier of operator, so that
+// the time goes on parsing expressions.
+BENCH(parse_exprs) {
+    static const char *ops[] = {" + ", " * ", " - ", " / ", " < ",
+                                " == ", " >= ", " != ", " > ", " <= "};
+
+    char *prog = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&prog, &len);
+    for (size_t i = 0; (size_t)ftell(f) < CORPUS_SIZE; i++) {
+        fprintf(f, "int f%zu() {\n", i);
+        for (size_t j = 0; j < 16; j++) {
+            fprintf(f, "    x%zu = ", j);
+            for (size_t k = 0; k < 32; k++) {
+                fprintf(f, "%s%s", k % 3 ? "a" : "-b", ops[(i + j + k) % 10]);
+            }
+            fprintf(f, "c;\n");
+        }
+        fprintf(f, "}\n");
+    }
+    fclose(f);
+
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, len);
+    bench_set_bytes(b, len);
+    while (bench_loop(b)) {
+        ast_program_t program;
+        parser_parse_tokens(idents, prog, tokens, NULL, &program);
+        ast_program_free(&program);
+    }
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+    free(prog);
+}
+
+// Parsing only what's needed to list the functions, skipping their bodies,
+// against parsing everything.
+BENCH(parse_lazy) {
+    size_t len;
+    char *prog = corpus_generate(CORPUS_SIZE, &len);
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, len);
+    bench_set_bytes(b, len);
+
+    bench_variant(b, "eager");
+    while (bench_loop(b)) {
+        ast_program_t program;
+        parser_parse_tokens(idents, prog, tokens, NULL, &program);
+        ast_program_free(&program);
+    }
+
+    struct parser_options opts = {.lazy_bodies = true};
+    bench_variant(b, "lazy");
+    while (bench_loop(b)) {
+        ast_program_t program;
+        parser_parse_tokens(idents, prog, tokens, &opts, &program);
+        ast_program_free(&program);
+    }
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+    free(prog);
+}
+
+// Parsing function bodies on a pool of threads, against parsing them as
+// they're found. The speedup is relative to that.
+BENCH(parse_parallel) {
+    size_t len;
+    char *prog = corpus_generate(CORPUS_SIZE, &len);
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, len);
+    bench_set_bytes(b, len);
+
+    bench_variant(b, "serial");
+    while (bench_loop(b)) {
+        ast_program_t program;
+        parser_parse_tokens(idents, prog, tokens, NULL, &program);
+        ast_program_free(&program);
+    }
+    double serial = bench_seconds(b);
+
+    static const size_t threads[] = {2, 4, 8};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        struct parser_options opts = {.jobs = threads[i]};
+        bench_variant(b, "threads=%zu", threads[i]);
+        while (bench_loop(b)) {
+            ast_program_t program;
+            parser_parse_tokens(idents, prog, tokens, &opts, &program);
+            ast_program_free(&program);
+        }
+        printf("\t    speedup: %.2fx\n", serial / bench_seconds(b));
+    }
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+    free(prog);
+}
+
+// Reparsing after an edit to one function, in sources of growing size. The
+// time per edit should stay the same.
+BENCH(parse_reparse) {
+    static const size_t sizes[] = {64 * 1024, 1024 * 1024, CORPUS_SIZE};
+    static const char insert[] = "1 + ";
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t len;
+        char *prog = corpus_generate(sizes[i], &len);
+        struct ident_table *idents = ident_table_new();
+
+        // An expression in the first function, and the source with it
+        // edited. Every other function comes after it.
+        size_t at = strstr(prog, "return ") - prog + 7;
+        char *edited = malloc(len + sizeof(insert));
+        memcpy(edited, prog, at);
+        memcpy(edited + at, insert, strlen(insert));
+        memcpy(edited + at + strlen(insert), prog + at, len - at);
+
+        // Each loop makes the edit, and then undoes it.
+        struct parser_edit edit = {.offset = at, .text = insert,
+                                   .text_len = strlen(insert)};
+        struct parser_edit undo = {.offset = at, .len = strlen(insert)};
+
+        ast_program_t program;
+        parser_parse(idents, prog, len, &program);
+        bench_variant(b, "%zuKB", len / 1024);
+        while (bench_loop(b)) {
+            parser_reparse(idents, prog, len, edit, NULL, &program);
+            parser_reparse(idents, edited, len + strlen(insert), undo, NULL,
+                           &program);
+        }
+        ast_program_free(&program);
+
+        ident_table_free(idents);
+        free(edited);
+        free(prog);
+    }
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ident.h"
+#include "symtab_define.h"
+
+#include "framework.h"
+
+#define NAMES 64
+
+SYMTAB_DEFINE(int_table, int)
+
+// Looking up names declared in the outermost scope, from the innermost of
+// scopes nested to each depth, each declaring a name of its own, as
+// generated code might. The symbol table finds a name's innermost binding
+// directly, so this shouldn't depend on the depth.
+BENCH(symtab_nested) {
+    static const size_t depths[] = {1, 16, 256, 4096};
+
+    struct ident_table *idents = ident_table_new();
+    struct ident *names[NAMES];
+    for (size_t i = 0; i < NAMES; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "v%zu", i);
+        names[i] = ident_from_str(idents, name);
+    }
+    volatile int sink = 0;
+
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        struct int_table t = {0};
+        for (size_t j = 0; j < NAMES; j++) {
+            int_table_declare(&t, names[j], 0);
+        }
+        for (size_t depth = 0; depth < depths[i]; depth++) {
+            char name[32];
+            snprintf(name, sizeof(name), "local%zu", depth);
+            struct ident *local = ident_from_str(idents, name);
+
+            int_table_enter(&t);
+            int_table_declare(&t, local, 0);
+        }
+
+        bench_variant(b, "depth=%zu", depths[i]);
+        while (bench_loop(b)) {
+            for (size_t j = 0; j < NAMES; j++) {
+                sink += *int_table_get(&t, names[j]);
+            }
+        }
+
+        int_table_free(&t);
+    }
+
+    ident_table_free(idents);
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "ast.h"
+#include "gen.h"
+#include "ident.h"
+#include "parser.h"
+#include "ty.h"
+#include "tycheck.h"
+
+#include "corpus.h"
+#include "framework.h"
+
+#define CORPUS_SIZE (256 * 1024)
+
+// Type checking and then generating code for the corpus, whose functions
+// each declare a handful of variables and a small struct. The heap used by
+// a type checker and the types it interns is printed.
+BENCH(tycheck_gen) {
+    size_t len;
+    char *prog = corpus_generate(CORPUS_SIZE, &len);
+    struct ident_table *idents = ident_table_new();
+    ast_program_t program;
+    parser_parse(idents, prog, len, &program);
+    bench_set_bytes(b, len);
+
+#if defined(__GLIBC__)
+    size_t before = mallinfo2().uordblks;
+#endif
+    struct ty_table *types = ty_table_new();
+    struct tycheck *tyc = tycheck_new(types);
+    tycheck_check(tyc, &program);
+#if defined(__GLIBC__)
+    printf("\t    heap used by tycheck: %zu bytes\n",
+           mallinfo2().uordblks - before);
+#endif
+    tycheck_free(tyc);
+
+    bench_variant(b, "tycheck");
+    while (bench_loop(b)) {
+        ty_table_free(types);
+        types = ty_table_new();
+        tyc = tycheck_new(types);
+        tycheck_check(tyc, &program);
+        tycheck_free(tyc);
+    }
+
+    FILE *out = fopen("/dev/null", "w");
+    bench_variant(b, "gen");
+    while (bench_loop(b)) {
+        gen_generate(out, program);
+    }
+    fclose(out);
+
+    ty_table_free(types);
+    ast_program_free(&program);
+    ident_table_free(idents);
+    free(prog);
+}
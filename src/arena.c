@@ -0,0 +1,124 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define CHUNK_SIZE (64 * 1024)
+// Allocations bigger than this get a chunk of their own, so that we don't
+// waste the rest of the current chunk.
+#define LARGE_ALLOC (CHUNK_SIZE / 4)
+#define ALIGNMENT (alignof(max_align_t))
+
+struct chunk {
+    struct chunk *prev;
+    size_t capacity;
+    alignas(max_align_t) char data[];
+};
+
+struct arena {
+    // Most recently allocated chunk, which we bump-allocate from. Older chunks
+    // are linked through chunk->prev.
+    struct chunk *head;
+    char *ptr;
+    char *end;
+
+    size_t used;
+};
+
+static size_t align_up(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static struct chunk *chunk_new(struct chunk *prev, size_t capacity) {
+    struct chunk *c = malloc(sizeof(struct chunk) + capacity);
+    if (c == NULL) {
+        abort();
+    }
+    c->prev = prev;
+    c->capacity = capacity;
+    return c;
+}
+
+struct arena *arena_new() { return calloc(1, sizeof(struct arena)); }
+
+void arena_free(struct arena *a) {
+    struct chunk *c = a->head;
+    while (c != NULL) {
+        struct chunk *prev = c->prev;
+        free(c);
+        c = prev;
+    }
+    free(a);
+}
+
+static void *alloc_large(struct arena *a, size_t size) {
+    // Link the large chunk behind the head, so we carry on bump-allocating
+    // from the current chunk.
+    if (a->head == NULL) {
+        a->head = chunk_new(NULL, size);
+        a->ptr = a->end = a->head->data + size;
+        return a->head->data;
+    }
+
+    struct chunk *c = chunk_new(a->head->prev, size);
+    a->head->prev = c;
+    return c->data;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    size = align_up(size == 0 ? 1 : size);
+    a->used += size;
+
+    if (size > LARGE_ALLOC) {
+        return alloc_large(a, size);
+    }
+
+    if ((size_t)(a->end - a->ptr) < size) {
+        a->head = chunk_new(a->head, CHUNK_SIZE);
+        a->ptr = a->head->data;
+        a->end = a->head->data + CHUNK_SIZE;
+    }
+
+    void *ptr = a->ptr;
+    a->ptr += size;
+    return ptr;
+}
+
+void *arena_calloc(struct arena *a, size_t size) {
+    void *ptr = arena_alloc(a, size);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void *arena_copy(struct arena *a, const void *src, size_t size) {
+    void *ptr = arena_alloc(a, size);
+    memcpy(ptr, src, size);
+    return ptr;
+}
+
+void arena_absorb(struct arena *a, struct arena *from) {
+    if (from->head != NULL) {
+        if (a->head == NULL) {
+            // Take over from's chunks, including the one it was bumping.
+            a->head = from->head;
+            a->ptr = from->ptr;
+            a->end = from->end;
+        } else {
+            // Link from's chunks behind a's head, so that we carry on
+            // bump-allocating from it.
+            struct chunk *tail = from->head;
+            while (tail->prev != NULL) {
+                tail = tail->prev;
+            }
+            tail->prev = a->head->prev;
+            a->head->prev = from->head;
+        }
+    }
+
+    a->used += from->used;
+    free(from);
+}
+
+size_t arena_used(struct arena *a) { return a->used; }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdlib.h>
+
+// Bump allocator. Allocations can't be freed individually: everything is
+// released at once by arena_free().
+struct arena;
+
+struct arena *arena_new();
+void arena_free(struct arena *a);
+
+// Returns uninitialised memory which is suitably aligned for any type.
+void *arena_alloc(struct arena *a, size_t size);
+// Returns zeroed memory which is suitably aligned for any type.
+void *arena_calloc(struct arena *a, size_t size);
+// Copies size bytes from src into the arena.
+void *arena_copy(struct arena *a, const void *src, size_t size);
+
+// Moves every allocation of from into a, and frees from. The allocations
+// stay where they are, but are now released with a.
+void arena_absorb(struct arena *a, struct arena *from);
+
+// Total bytes handed out by the arena, for statistics.
+size_t arena_used(struct arena *a);
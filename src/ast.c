@@ -2,12 +2,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
 #include "ast.h"
 #include "common.h"
 #include "ident.h"
 #include "map.h"
 #include "pprint.h"
 #include "ty.h"
+#include "vec_define.h"
 
 static const char *_expr_binop(ast_expr_t *expr);
 static const char *_expr_assignop(ast_expr_t *expr);
@@ -56,108 +58,153 @@ static const char *_expr_assignop(ast_expr_t *expr) {
     }
 }
 
-static void _expr_unop(struct pprint *pp, ast_expr_t *expr) {
+static const char *_expr_unop(ast_expr_t *expr) {
     switch (expr->unop) {
     case Ast_UnOp_Negation:
-        pprintf(pp, "Neg(");
-        ast_pprint_expr(pp, expr->lhs);
-        pprintf(pp, ")");
-        break;
-
+        return "Neg";
     case Ast_UnOp_AddressOf:
-        pprintf(pp, "AddrOf(");
-        ast_pprint_expr(pp, expr->lhs);
-        pprintf(pp, ")");
-        break;
-
+        return "AddrOf";
     case Ast_UnOp_Deref:
-        pprintf(pp, "Deref(");
-        ast_pprint_expr(pp, expr->lhs);
-        pprintf(pp, ")");
-        break;
+        return "Deref";
+    default:
+        return "UNKNOWN_OP";
     }
 }
 
-void ast_pprint_expr(struct pprint *pp, ast_expr_t *expr) {
-    switch (expr->discrim) {
-    case Ast_Expr_Constant:
-        pprintf(pp, "%s", expr->str);
-        break;
+void ast_program_free(ast_program_t *prog) {
+    map_free(prog->functions);
+    arena_free(prog->arena);
+}
 
-    case Ast_Expr_Var:
-        pprintf(pp, "Var(%s)", ident_to_str(expr->ident));
-        break;
+// A step of printing an expression. See ast_pprint_expr().
+struct pprint_step {
+    ast_expr_idx_t idx;
+    // Which step of the node's printing this is, from 0.
+    uint8_t step;
+};
 
-    case Ast_Expr_BinOp:
-        pprintf(pp, "Expr(");
-        ast_pprint_expr(pp, expr->lhs);
-        pprintf(pp, " %s ", _expr_binop(expr));
-        ast_pprint_expr(pp, expr->rhs);
-        pprintf(pp, ")");
-        break;
+VEC_DEFINE(pprint_stack, struct pprint_step)
 
-    case Ast_Expr_UnOp:
-        pprintf(pp, "Expr(");
-        _expr_unop(pp, expr);
-        pprintf(pp, ")");
-        break;
+static void later(struct pprint_stack *work, ast_expr_idx_t idx,
+                  uint8_t step) {
+    pprint_stack_push(work, (struct pprint_step){.idx = idx, .step = step});
+}
 
-    case Ast_Expr_AssignOp:
-        pprintf(pp, "Assign(");
-        ast_pprint_expr(pp, expr->lhs);
-        pprintf(pp, " %s ", _expr_assignop(expr));
-        ast_pprint_expr(pp, expr->rhs);
-        pprintf(pp, ")");
-        break;
+// Chains of left-associative operators make trees as deep as the chain is
+// long, so, as gen_expr() does, this works through a stack of steps rather
+// than recursing into operands. A node's steps print the text between its
+// operands, with its operands' steps scheduled in between.
+void ast_pprint_expr(struct pprint *pp, struct ast_nodes *nodes,
+                     ast_expr_idx_t root) {
+    struct pprint_stack work = {0};
+    later(&work, root, 0);
+
+    while (pprint_stack_len(&work) > 0) {
+        struct pprint_step next = pprint_stack_pop(&work);
+        ast_expr_t *expr = &nodes->exprs[next.idx];
+
+        switch (expr->discrim) {
+        case Ast_Expr_Constant: {
+            struct ast_const *c = &nodes->consts[expr->constant];
+            pprintf(pp, "%.*s", (int)c->len, c->str);
+            break;
+        }
+
+        case Ast_Expr_Var:
+            pprintf(pp, "Var(%s)", ident_to_str(nodes->idents[expr->ident]));
+            break;
+
+        case Ast_Expr_BinOp:
+        case Ast_Expr_AssignOp:
+            switch (next.step) {
+            case 0:
+                pprintf(pp, expr->discrim == Ast_Expr_BinOp ? "Expr("
+                                                            : "Assign(");
+                later(&work, next.idx, 1);
+                later(&work, expr->lhs, 0);
+                break;
+            case 1:
+                pprintf(pp, " %s ", expr->discrim == Ast_Expr_BinOp
+                                        ? _expr_binop(expr)
+                                        : _expr_assignop(expr));
+                later(&work, next.idx, 2);
+                later(&work, expr->rhs, 0);
+                break;
+            case 2:
+                pprintf(pp, ")");
+                break;
+            }
+            break;
+
+        case Ast_Expr_UnOp:
+            if (next.step == 0) {
+                pprintf(pp, "Expr(%s(", _expr_unop(expr));
+                later(&work, next.idx, 1);
+                later(&work, expr->lhs, 0);
+            } else {
+                pprintf(pp, "))");
+            }
+            break;
 
-    case Ast_Expr_MemberOf:
-        pprintf(pp, "MemberOf(");
-        if (expr->member.deref) {
-            pprintf(pp, "*");
+        case Ast_Expr_MemberOf:
+            if (next.step == 0) {
+                pprintf(pp, "MemberOf(");
+                if (expr->deref) {
+                    pprintf(pp, "*");
+                }
+                later(&work, next.idx, 1);
+                later(&work, expr->lhs, 0);
+            } else {
+                pprintf(pp, ", ");
+                pprintf(pp, "%s", ident_to_str(nodes->idents[expr->ident]));
+                pprintf(pp, ")");
+            }
+            break;
         }
-        ast_pprint_expr(pp, expr->member.lhs);
-        pprintf(pp, ", ");
-        pprintf(pp, "%s", ident_to_str(expr->member.ident));
-        pprintf(pp, ")");
-        break;
     }
+
+    pprint_stack_free(&work);
 }
 
-void ast_pprint_statement(struct pprint *pp, ast_statement_t *stmt) {
+void ast_pprint_statement(struct pprint *pp, struct ast_nodes *nodes,
+                          ast_stmt_idx_t idx) {
+    ast_statement_t *stmt = &nodes->stmts[idx];
+
     pprintf(pp, "Statement(");
 
     switch (stmt->kind) {
     case Ast_Statement_Return:
         pprintf(pp, "Return(");
-        ast_pprint_expr(pp, stmt->expr);
+        ast_pprint_expr(pp, nodes, stmt->expr);
         pprintf(pp, ")");
         break;
 
     case Ast_Statement_If:
         pprintf(pp, "If(");
-        ast_pprint_expr(pp, stmt->expr);
+        ast_pprint_expr(pp, nodes, stmt->expr);
         pprintf(pp, ", ");
-        ast_pprint_statement(pp, stmt->arm1);
-        if (stmt->arm2 != NULL) {
+        ast_pprint_statement(pp, nodes, stmt->arm1);
+        if (stmt->arm2 != AST_NONE) {
             pprintf(pp, ", ");
-            ast_pprint_statement(pp, stmt->arm2);
+            ast_pprint_statement(pp, nodes, stmt->arm2);
         }
         pprintf(pp, ")");
         break;
 
     case Ast_Statement_Block:
-        ast_pprint_block(pp, stmt->block);
+        ast_pprint_block(pp, nodes, &nodes->blocks[stmt->block]);
         break;
 
     case Ast_Statement_Expr:
-        ast_pprint_expr(pp, stmt->expr);
+        ast_pprint_expr(pp, nodes, stmt->expr);
         break;
     }
 
     pprintf(pp, ")");
 }
 
-void ast_pprint_block(struct pprint *pp, ast_block_t *block) {
+void ast_pprint_block(struct pprint *pp, struct ast_nodes *nodes,
+                      ast_block_t *block) {
     pprintf(pp, "Block(");
 
     pprint_indent(pp);
@@ -168,10 +215,10 @@ void ast_pprint_block(struct pprint *pp, ast_block_t *block) {
     for (size_t i = 0; i < block->nitems; i++) {
         switch (block->items[i].kind) {
         case Ast_BlockItem_Statement:
-            ast_pprint_statement(pp, &block->items[i].stmt);
+            ast_pprint_statement(pp, nodes, block->items[i].stmt);
             break;
         case Ast_BlockItem_Declaration:
-            ast_pprint_declaration(pp, &block->items[i].decl);
+            ast_pprint_declaration(pp, nodes, &block->items[i].decl);
             break;
         }
 
@@ -188,21 +235,16 @@ void ast_pprint_block(struct pprint *pp, ast_block_t *block) {
 
 void ast_pprint_function(struct pprint *pp, ast_function_t *func) {
     pprintf(pp, "Function(name=%s, ", ident_to_str(func->ident));
-    ast_pprint_block(pp, &func->block);
+    ast_pprint_block(pp, &func->nodes, &func->block);
     pprintf(pp, ")");
 
     pprint_newline(pp);
 }
 
-static bool ast_pprint_function_iter(void *context, const void *key,
-                                     void *value) {
-    UNUSED(key);
-    ast_pprint_function((struct pprint *)context, value);
-    return true;
-}
-
 void ast_pprint_program(struct pprint *pp, ast_program_t *prog) {
-    map_iter(prog->functions, pp, &ast_pprint_function_iter);
+    for (size_t i = 0; i < prog->nfunctions; i++) {
+        ast_pprint_function(pp, prog->ordered[i]);
+    }
 }
 
 void ast_pprint_declarator(struct pprint *pp, struct ast_declarator *decl) {
@@ -306,7 +348,8 @@ void ast_pprint_type(struct pprint *pp, struct ast_type *ty) {
     }
 }
 
-void ast_pprint_declaration(struct pprint *pp, struct ast_declaration *decl) {
+void ast_pprint_declaration(struct pprint *pp, struct ast_nodes *nodes,
+                            struct ast_declaration *decl) {
     pprintf(pp, "Decl(");
     ast_pprint_type(pp, &decl->type);
     pprintf(pp, ", ");
@@ -324,9 +367,9 @@ void ast_pprint_declaration(struct pprint *pp, struct ast_declaration *decl) {
 
         ast_pprint_declarator(pp, &decl->declarators[i]);
 
-        if (decl->exprs[i] != NULL) {
+        if (decl->exprs[i] != AST_NONE) {
             pprintf(pp, ", = ");
-            ast_pprint_expr(pp, decl->exprs[i]);
+            ast_pprint_expr(pp, nodes, decl->exprs[i]);
         }
 
         if (decl->ndeclarators > 1) {
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "diag.h"
 #include "map.h"
 #include "pprint.h"
 #include "ty.h"
@@ -35,55 +38,71 @@ typedef enum {
     Ast_AssignOp_Division,
 } ast_assignop_t;
 
-typedef struct ast_expr_t {
-    enum {
-        Ast_Expr_Constant,
-        Ast_Expr_Var,
-        Ast_Expr_UnOp,
-        Ast_Expr_BinOp,
-        Ast_Expr_AssignOp,
-        // postfix-expr in grammar:
-        Ast_Expr_MemberOf,
-    } discrim;
+// Expressions and statements are stored flattened in per-function arrays (see
+// struct ast_nodes) and refer to their children by 32-bit index into those
+// arrays, rather than by pointer.
+typedef uint32_t ast_expr_idx_t;
+typedef uint32_t ast_stmt_idx_t;
+typedef uint32_t ast_block_idx_t;
+
+// Used for optional children.
+#define AST_NONE UINT32_MAX
+
+enum ast_expr_kind {
+    Ast_Expr_Constant,
+    Ast_Expr_Var,
+    Ast_Expr_UnOp,
+    Ast_Expr_BinOp,
+    Ast_Expr_AssignOp,
+    // postfix-expr in grammar:
+    Ast_Expr_MemberOf,
+};
+
+typedef struct {
+    // enum ast_expr_kind. The enums are stored narrowly to keep nodes small.
+    uint8_t discrim;
     union {
-        // Ast_Expr_Constant:
-        const char *str;
-        // Ast_Expr_Var:
-        struct ident *ident;
-        // Ast_Expr_UnOp:
-        ast_unop_t unop;
-        // Ast_Expr_Binop:
-        ast_binop_t binop;
-        // Ast_Expr_AssignOp:
-        ast_assignop_t assignop;
+        // Ast_Expr_UnOp (ast_unop_t):
+        uint8_t unop;
+        // Ast_Expr_BinOp (ast_binop_t):
+        uint8_t binop;
+        // Ast_Expr_AssignOp (ast_assignop_t):
+        uint8_t assignop;
         // Ast_Expr_MemberOf:
-        struct {
-            bool deref;
-            struct ast_expr_t *lhs;
-            struct ident *ident;
-        } member;
+        bool deref;
+    };
+    // Ast_Expr_UnOp, Ast_Expr_BinOp, Ast_Expr_AssignOp, Ast_Expr_MemberOf:
+    ast_expr_idx_t lhs;
+    union {
+        // Ast_Expr_Constant, index into consts:
+        uint32_t constant;
+        // Ast_Expr_Var, Ast_Expr_MemberOf, index into idents:
+        uint32_t ident;
+        // Ast_Expr_BinOp, Ast_Expr_AssignOp:
+        ast_expr_idx_t rhs;
     };
-    // Ast_Expr_UnOp, Ast_Expr_Binop, Ast_Expr_Assign:
-    struct ast_expr_t *lhs, *rhs;
 } ast_expr_t;
 
-struct ast_block_t;
-
-typedef struct ast_statement_t {
-    enum {
-        Ast_Statement_Return,
-        Ast_Statement_If,
-        Ast_Statement_Block,
-        Ast_Statement_Expr,
+enum ast_statement_kind {
+    Ast_Statement_Return,
+    Ast_Statement_If,
+    Ast_Statement_Block,
+    Ast_Statement_Expr,
+};
 
-    } kind;
-    // Ast_Statement_Return, Ast_Statement_Decl, Ast_Statement_Expr,
-    // Ast_Statement_If:
-    ast_expr_t *expr;
-    // Ast_Statement_If:
-    struct ast_statement_t *arm1, *arm2;
-    // Ast_Statement_Block:
-    struct ast_block_t *block;
+typedef struct {
+    // enum ast_statement_kind:
+    uint8_t kind;
+    // Ast_Statement_Return, Ast_Statement_Expr, Ast_Statement_If:
+    ast_expr_idx_t expr;
+    union {
+        // Ast_Statement_If. arm2 is AST_NONE if there's no else:
+        struct {
+            ast_stmt_idx_t arm1, arm2;
+        };
+        // Ast_Statement_Block:
+        ast_block_idx_t block;
+    };
 } ast_statement_t;
 
 typedef struct ast_block_t {
@@ -91,18 +110,80 @@ typedef struct ast_block_t {
     size_t nitems;
 } ast_block_t;
 
+// The text of a constant, pointing into the source. Not NUL-terminated.
+struct ast_const {
+    const char *str;
+    uint32_t len;
+};
+
+// Flattened storage for the nodes of a function body.
+struct ast_nodes {
+    ast_expr_t *exprs;
+    ast_statement_t *stmts;
+    // Blocks other than the function's top-level block:
+    ast_block_t *blocks;
+
+    // Side tables, to keep the payload of leaf expressions out of the nodes:
+    struct ast_const *consts;
+    struct ident **idents;
+
+    uint32_t nexprs, nstmts, nblocks, nconsts, nidents;
+};
+
 typedef struct {
     struct ident *ident;
+    // block and nodes are only set once the body has been parsed, which may
+    // be deferred until it's needed. See parser_parse_body().
+    enum {
+        Ast_Body_Unparsed,
+        Ast_Body_Parsed,
+        // The body has an error, which is kept so that it's reported once.
+        Ast_Body_Failed,
+    } body;
+    // Ast_Body_Failed:
+    diag_t error;
     ast_block_t block;
+    struct ast_nodes nodes;
+    // Tokens of the body, from its opening brace to one past its closing
+    // brace.
+    uint32_t body_begin, body_end;
+    // Bytes of the source, from the start of the function to one past its
+    // closing brace.
+    uint32_t begin, end;
 } ast_function_t;
 
+// What the parser needs to parse bodies later. Private to the parser.
+struct parser_lazy;
+
 typedef struct {
-    struct map *functions; // ast_function_t
+    // map[const char*]ast_function_t*
+    struct map *functions;
+    // The same functions, in the order they appear in the source. Walkers use
+    // this so that their output doesn't depend on the map's hash order.
+    ast_function_t **ordered;
+    size_t nfunctions;
+
+    // Owns every node in the program.
+    struct arena *arena;
+
+    // NULL if every body was parsed up front.
+    struct parser_lazy *lazy;
+
+    // After parser_reparse(), the begin and end of the functions from
+    // ordered[shifted] on may be shift bytes behind. See
+    // parser_update_offsets().
+    size_t shifted;
+    uint32_t shift;
 } ast_program_t;
 
-void ast_pprint_expr(struct pprint *pp, ast_expr_t *expr);
-void ast_pprint_statement(struct pprint *pp, ast_statement_t *statment);
-void ast_pprint_block(struct pprint *pp, ast_block_t *block);
+void ast_program_free(ast_program_t *prog);
+
+void ast_pprint_expr(struct pprint *pp, struct ast_nodes *nodes,
+                     ast_expr_idx_t expr);
+void ast_pprint_statement(struct pprint *pp, struct ast_nodes *nodes,
+                          ast_stmt_idx_t stmt);
+void ast_pprint_block(struct pprint *pp, struct ast_nodes *nodes,
+                      ast_block_t *block);
 void ast_pprint_function(struct pprint *pp, ast_function_t *func);
 void ast_pprint_program(struct pprint *pp, ast_program_t *prog);
 
@@ -169,10 +250,10 @@ struct ast_struct_declaration {
 
 struct ast_declaration {
     struct ast_type type;
-    // There are ndeclarators of declarators and exprs. The expr might be NULL
-    // if there is no initializer.
+    // There are ndeclarators of declarators and exprs. The expr is AST_NONE if
+    // there is no initializer.
     struct ast_declarator *declarators;
-    ast_expr_t **exprs;
+    ast_expr_idx_t *exprs;
     size_t ndeclarators;
 };
 
@@ -180,7 +261,8 @@ void ast_pprint_declarator(struct pprint *pp, struct ast_declarator *decl);
 void ast_pprint_struct_declaration(struct pprint *pp,
                                    struct ast_struct_declaration *decl);
 void ast_pprint_type(struct pprint *pp, struct ast_type *ty);
-void ast_pprint_declaration(struct pprint *pp, struct ast_declaration *decl);
+void ast_pprint_declaration(struct pprint *pp, struct ast_nodes *nodes,
+                            struct ast_declaration *decl);
 
 struct ast_block_item {
     enum {
@@ -188,7 +270,7 @@ struct ast_block_item {
         Ast_BlockItem_Statement,
     } kind;
     union {
-        ast_statement_t stmt;
+        ast_stmt_idx_t stmt;
         struct ast_declaration decl;
     };
 };
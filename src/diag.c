@@ -4,16 +4,66 @@
 #include "diag.h"
 #include "lexer.h"
 
-void diag_print(const char *prog, diag_t *diag) {
+void diag_print(const char *prog, size_t len, struct lines *lines,
+                diag_t *diag) {
     printf("---\n");
 
-    printf("%.*s", (int)(diag->span.start - prog), prog);
-    printf("\033[1;31m%.*s\033[0m",
-           (int)(diag->span.end - diag->span.start) + 1, diag->span.start);
-    printf("%s\n\n", diag->span.end + 1);
+    const char *start = prog + diag->span.offset;
+    printf("%.*s", (int)diag->span.offset, prog);
+    printf("\033[1;31m%.*s\033[0m", (int)diag->span.len, start);
+    const char *rest = start + diag->span.len;
+    if (rest > prog + len) {
+        rest = prog + len;
+    }
+    printf("%.*s\n\n", (int)(prog + len - rest), rest);
 
-    printf("Line %d, Column %d\n", diag->span.line, diag->span.character);
+    unsigned int line, column;
+    lines_position(lines, diag->span.offset, &line, &column);
+    printf("Line %u, Column %u\n", line, column);
     printf("Error: %s\n", diag->msg);
 
     printf("---\n");
 }
+
+bool diags_report(struct diags *diags, diag_t diag) {
+    size_t max = diags->max != 0 ? diags->max : DIAGS_MAX;
+    bool full = diags->len == max;
+    if (full) {
+        // Keep the earliest, whatever order they were reported in.
+        diags->truncated = true;
+        if (diag.span.offset >= diags->list[max - 1].span.offset) {
+            return false;
+        }
+        diags->len--;
+    } else if (diags->len == diags->capacity) {
+        diags->capacity = diags->capacity == 0 ? 4 : diags->capacity * 2;
+        diags->list = realloc(diags->list, diags->capacity * sizeof(diag_t));
+    }
+
+    // Almost always found in order, so this rarely moves anything.
+    size_t i = diags->len;
+    while (i > 0 && diags->list[i - 1].span.offset > diag.span.offset) {
+        i--;
+    }
+    memmove(&diags->list[i + 1], &diags->list[i],
+            (diags->len - i) * sizeof(diag_t));
+    diags->list[i] = diag;
+    diags->len++;
+
+    return !full;
+}
+
+void diags_print(const char *prog, size_t len, struct lines *lines,
+                 struct diags *diags) {
+    for (size_t i = 0; i < diags->len; i++) {
+        diag_print(prog, len, lines, &diags->list[i]);
+    }
+    if (diags->truncated) {
+        printf("Too many errors, stopping after %zu\n", diags->len);
+    }
+}
+
+void diags_free(struct diags *diags) {
+    free(diags->list);
+    *diags = (struct diags){0};
+}
@@ -1,10 +1,39 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdlib.h>
+
 #include "lexer.h"
+#include "lines.h"
 
 typedef struct {
     token_span_t span;
     const char *msg;
 } diag_t;
 
-void diag_print(const char *prog, diag_t *diag);
+void diag_print(const char *prog, size_t len, struct lines *lines,
+                diag_t *diag);
+
+// The most diagnostics kept from one run. Past the first few errors, the
+// rest are mostly knock-on effects, and printing each one costs time in
+// proportion to the input, so an input full of errors would be quadratic.
+#define DIAGS_MAX 20
+
+// Diagnostics collected over a run, kept in order of position. A zeroed
+// struct diags is an empty list.
+struct diags {
+    diag_t *list;
+    size_t len;
+    size_t capacity;
+    // At most this many are kept. 0 means DIAGS_MAX.
+    size_t max;
+    // Set if any were dropped because the list was full.
+    bool truncated;
+};
+
+// Adds a diagnostic. Returns false if the list was already full, which
+// tells the caller to give up: the latest one in the source is dropped.
+bool diags_report(struct diags *diags, diag_t diag);
+void diags_print(const char *prog, size_t len, struct lines *lines,
+                 struct diags *diags);
+void diags_free(struct diags *diags);
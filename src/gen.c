@@ -8,144 +8,232 @@
 #include "gen.h"
 #include "ident.h"
 #include "layout.h"
-#include "map.h"
-#include "scope.h"
+#include "symtab_define.h"
+#include "vec_define.h"
+
+// Stack offset of each variable in scope.
+SYMTAB_DEFINE(var_table, size_t)
+
+// A step of generating an expression. See gen_expr().
+struct gen_step {
+    ast_expr_idx_t idx;
+    // Which step of the node's generation this is, from 0.
+    uint8_t step;
+};
+
+VEC_DEFINE(gen_stack, struct gen_step)
 
 struct state {
     FILE *f;
 
     size_t stack_idx;
 
-    struct scope *env;
+    // Shared by every function.
+    struct var_table *env;
+
+    // Steps of gen_expr() still to run.
+    struct gen_stack work;
+
+    // Nodes of the function being generated.
+    struct ast_nodes *nodes;
 
     uint64_t label_idx;
+
+    // Set once an error has been reported. The output is no use after that.
+    bool failed;
 };
 
+// Reports an error if ident isn't declared, and carries on as if it were.
 static size_t var_idx(struct state *s, struct ident *ident) {
-    return *(size_t *)scope_get(s->env, ident);
+    size_t *idx = var_table_get(s->env, ident);
+    if (idx == NULL) {
+        fprintf(stderr, "error: use of undeclared identifier '%s'\n",
+                ident_to_str(ident));
+        s->failed = true;
+        return 0;
+    }
+    return *idx;
+}
+
+static ast_expr_t *node(struct state *s, ast_expr_idx_t idx) {
+    return &s->nodes->exprs[idx];
+}
+
+static struct ident *node_ident(struct state *s, ast_expr_idx_t idx) {
+    return s->nodes->idents[node(s, idx)->ident];
 }
 
-static bool gen_expr(struct state *s, ast_expr_t *expr) {
-    switch (expr->discrim) {
-    case Ast_Expr_Constant:
-        fprintf(s->f, "mov $%s, %%rax\n", expr->str);
+// Operates on the lhs in %rax and the rhs in %rcx, leaving the result in
+// %rax.
+static void gen_binop(struct state *s, ast_binop_t binop) {
+    switch (binop) {
+    case Ast_BinOp_Addition:
+        fprintf(s->f, "add %%rcx, %%rax\n");
         break;
-    case Ast_Expr_Var:
-        fprintf(s->f, "mov -%zu(%%rbp), %%rax\n", var_idx(s, expr->ident));
+    case Ast_BinOp_Subtraction:
+        fprintf(s->f, "sub %%rcx, %%rax\n");
         break;
-    case Ast_Expr_BinOp:
-        gen_expr(s, expr->rhs);
-        fprintf(s->f, "pushq %%rax\n");
-        gen_expr(s, expr->lhs);
-        fprintf(s->f, "popq %%rcx\n");
+    case Ast_BinOp_Multiplication:
+        fprintf(s->f, "imul %%rcx, %%rax\n");
+        break;
+    case Ast_BinOp_Division:
+        fprintf(s->f, "mov $0, %%rdx\n");
+        fprintf(s->f, "idiv %%rcx\n");
+        break;
+    case Ast_BinOp_Equal:
+        fprintf(s->f, "cmp %%rcx, %%rax\n");
+        fprintf(s->f, "mov $0, %%rax\n");
+        fprintf(s->f, "sete %%al\n");
+        break;
+    case Ast_BinOp_NotEqual:
+        fprintf(s->f, "cmp %%rcx, %%rax\n");
+        fprintf(s->f, "mov $0, %%rax\n");
+        fprintf(s->f, "setne %%al\n");
+        break;
+    case Ast_BinOp_LessThan:
+        fprintf(s->f, "cmp %%rcx, %%rax\n");
+        fprintf(s->f, "mov $0, %%rax\n");
+        fprintf(s->f, "setl %%al\n");
+        break;
+    case Ast_BinOp_LessThanEqual:
+        fprintf(s->f, "cmp %%rcx, %%rax\n");
+        fprintf(s->f, "mov $0, %%rax\n");
+        fprintf(s->f, "setle %%al\n");
+        break;
+    case Ast_BinOp_GreaterThan:
+        fprintf(s->f, "cmp %%rcx, %%rax\n");
+        fprintf(s->f, "mov $0, %%rax\n");
+        fprintf(s->f, "setg %%al\n");
+        break;
+    case Ast_BinOp_GreaterThanEqual:
+        fprintf(s->f, "cmp %%rcx, %%rax\n");
+        fprintf(s->f, "mov $0, %%rax\n");
+        fprintf(s->f, "setge %%al\n");
+        break;
+    }
+}
 
-        switch (expr->binop) {
-        case Ast_BinOp_Addition:
-            fprintf(s->f, "add %%rcx, %%rax\n");
-            break;
-        case Ast_BinOp_Subtraction:
-            fprintf(s->f, "sub %%rcx, %%rax\n");
-            break;
-        case Ast_BinOp_Multiplication:
-            fprintf(s->f, "imul %%rcx, %%rax\n");
-            break;
-        case Ast_BinOp_Division:
-            fprintf(s->f, "mov $0, %%rdx\n");
-            fprintf(s->f, "idiv %%rcx\n");
-            break;
-        case Ast_BinOp_Equal:
-            fprintf(s->f, "cmp %%rcx, %%rax\n");
-            fprintf(s->f, "mov $0, %%rax\n");
-            fprintf(s->f, "sete %%al\n");
-            break;
-        case Ast_BinOp_NotEqual:
-            fprintf(s->f, "cmp %%rcx, %%rax\n");
-            fprintf(s->f, "mov $0, %%rax\n");
-            fprintf(s->f, "setne %%al\n");
-            break;
-        case Ast_BinOp_LessThan:
-            fprintf(s->f, "cmp %%rcx, %%rax\n");
-            fprintf(s->f, "mov $0, %%rax\n");
-            fprintf(s->f, "setl %%al\n");
-            break;
-        case Ast_BinOp_LessThanEqual:
-            fprintf(s->f, "cmp %%rcx, %%rax\n");
-            fprintf(s->f, "mov $0, %%rax\n");
-            fprintf(s->f, "setle %%al\n");
-            break;
-        case Ast_BinOp_GreaterThan:
-            fprintf(s->f, "cmp %%rcx, %%rax\n");
-            fprintf(s->f, "mov $0, %%rax\n");
-            fprintf(s->f, "setg %%al\n");
-            break;
-        case Ast_BinOp_GreaterThanEqual:
-            fprintf(s->f, "cmp %%rcx, %%rax\n");
-            fprintf(s->f, "mov $0, %%rax\n");
-            fprintf(s->f, "setge %%al\n");
-            break;
-        }
+// Stores the rhs in %rax into the variable on the left of the assignment.
+static void gen_assignop(struct state *s, ast_expr_t *expr) {
+    switch (expr->assignop) {
+    case Ast_AssignOp_Assign:
+        fprintf(s->f, "mov %%rax, ");
         break;
-    case Ast_Expr_UnOp:
-        switch (expr->unop) {
-        case Ast_UnOp_Negation:
-            gen_expr(s, expr->lhs);
-            fprintf(s->f, "neg %%rax\n");
-            break;
-        case Ast_UnOp_AddressOf:
-            if (expr->lhs->discrim != Ast_Expr_Var) {
-                printf("error: can only take address of variables\n");
-                exit(-1);
-            }
-            fprintf(s->f, "mov %%rbp, %%rax\n");
-            fprintf(s->f, "sub $%zu, %%rax\n", var_idx(s, expr->lhs->ident));
-            break;
-        case Ast_UnOp_Deref:
-            if (expr->lhs->discrim != Ast_Expr_Var) {
-                printf("error: can only take address of variables\n");
-                exit(-1);
-            }
-            fprintf(s->f, "mov -%zu(%%rbp), %%rax\n",
-                    var_idx(s, expr->lhs->ident));
-            fprintf(s->f, "mov (%%rax), %%rax\n");
-            break;
-        }
+    case Ast_AssignOp_Addition:
+        fprintf(s->f, "add %%rax, ");
         break;
-    case Ast_Expr_AssignOp:
-        if (expr->lhs->discrim != Ast_Expr_Var) {
-            printf("error: can only assign to variables\n");
-            exit(-1);
-        }
+    case Ast_AssignOp_Subtraction:
+        fprintf(s->f, "sub %%rax, ");
+        break;
+    case Ast_AssignOp_Multiplication:
+        fprintf(s->f, "mov %%rax, %%rcx\n");
+        fprintf(s->f, "mov -%zu(%%rbp), %%rax\n",
+                var_idx(s, node_ident(s, expr->lhs)));
+        fprintf(s->f, "imul %%rcx, %%rax\n");
+        fprintf(s->f, "mov %%rax, ");
+        break;
+    case Ast_AssignOp_Division:
+        fprintf(s->f, "mov %%rax, %%rcx\n");
+        fprintf(s->f, "mov $0, %%rdx\n");
+        fprintf(s->f, "mov -%zu(%%rbp), %%rax\n",
+                var_idx(s, node_ident(s, expr->lhs)));
+        fprintf(s->f, "idiv %%rcx\n");
+        fprintf(s->f, "mov %%rax, ");
+        break;
+    }
 
-        gen_expr(s, expr->rhs);
+    fprintf(s->f, "-%zu(%%rbp)\n", var_idx(s, node_ident(s, expr->lhs)));
+}
 
-        switch (expr->assignop) {
-        case Ast_AssignOp_Assign:
-            fprintf(s->f, "mov %%rax, ");
-            break;
-        case Ast_AssignOp_Addition:
-            fprintf(s->f, "add %%rax, ");
-            break;
-        case Ast_AssignOp_Subtraction:
-            fprintf(s->f, "sub %%rax, ");
+// Schedules a step of generating an expression, to run after everything
+// scheduled after it.
+static void later(struct state *s, ast_expr_idx_t idx, uint8_t step) {
+    gen_stack_push(&s->work, (struct gen_step){.idx = idx, .step = step});
+}
+
+// Chains of left-associative operators make trees as deep as the chain is
+// long, so rather than recursing into operands, gen_expr() works through a
+// stack of steps. An operator's steps are run in turn, with its operands'
+// steps scheduled in between.
+static bool gen_expr(struct state *s, ast_expr_idx_t root) {
+    later(s, root, 0);
+
+    while (gen_stack_len(&s->work) > 0) {
+        struct gen_step next = gen_stack_pop(&s->work);
+        ast_expr_t *expr = node(s, next.idx);
+
+        switch (expr->discrim) {
+        case Ast_Expr_Constant: {
+            struct ast_const *c = &s->nodes->consts[expr->constant];
+            fprintf(s->f, "mov $%.*s, %%rax\n", (int)c->len, c->str);
             break;
-        case Ast_AssignOp_Multiplication:
-            fprintf(s->f, "mov %%rax, %%rcx\n");
+        }
+        case Ast_Expr_Var:
             fprintf(s->f, "mov -%zu(%%rbp), %%rax\n",
-                    var_idx(s, expr->lhs->ident));
-            fprintf(s->f, "imul %%rcx, %%rax\n");
-            fprintf(s->f, "mov %%rax, ");
+                    var_idx(s, node_ident(s, next.idx)));
             break;
-        case Ast_AssignOp_Division:
-            fprintf(s->f, "mov %%rax, %%rcx\n");
-            fprintf(s->f, "mov $0, %%rdx\n");
-            fprintf(s->f, "mov -%zu(%%rbp), %%rax\n",
-                    var_idx(s, expr->lhs->ident));
-            fprintf(s->f, "idiv %%rcx\n");
-            fprintf(s->f, "mov %%rax, ");
+        case Ast_Expr_BinOp:
+            // The rhs is generated first, and kept on the stack while the
+            // lhs is generated.
+            switch (next.step) {
+            case 0:
+                later(s, next.idx, 1);
+                later(s, expr->rhs, 0);
+                break;
+            case 1:
+                fprintf(s->f, "pushq %%rax\n");
+                later(s, next.idx, 2);
+                later(s, expr->lhs, 0);
+                break;
+            case 2:
+                fprintf(s->f, "popq %%rcx\n");
+                gen_binop(s, expr->binop);
+                break;
+            }
             break;
-        }
+        case Ast_Expr_UnOp:
+            switch (expr->unop) {
+            case Ast_UnOp_Negation:
+                if (next.step == 0) {
+                    later(s, next.idx, 1);
+                    later(s, expr->lhs, 0);
+                } else {
+                    fprintf(s->f, "neg %%rax\n");
+                }
+                break;
+            case Ast_UnOp_AddressOf:
+                if (node(s, expr->lhs)->discrim != Ast_Expr_Var) {
+                    printf("error: can only take address of variables\n");
+                    exit(-1);
+                }
+                fprintf(s->f, "mov %%rbp, %%rax\n");
+                fprintf(s->f, "sub $%zu, %%rax\n",
+                        var_idx(s, node_ident(s, expr->lhs)));
+                break;
+            case Ast_UnOp_Deref:
+                if (node(s, expr->lhs)->discrim != Ast_Expr_Var) {
+                    printf("error: can only take address of variables\n");
+                    exit(-1);
+                }
+                fprintf(s->f, "mov -%zu(%%rbp), %%rax\n",
+                        var_idx(s, node_ident(s, expr->lhs)));
+                fprintf(s->f, "mov (%%rax), %%rax\n");
+                break;
+            }
+            break;
+        case Ast_Expr_AssignOp:
+            if (node(s, expr->lhs)->discrim != Ast_Expr_Var) {
+                printf("error: can only assign to variables\n");
+                exit(-1);
+            }
 
-        fprintf(s->f, "-%zu(%%rbp)\n", var_idx(s, expr->lhs->ident));
+            if (next.step == 0) {
+                later(s, next.idx, 1);
+                later(s, expr->rhs, 0);
+            } else {
+                gen_assignop(s, expr);
+            }
+        }
     }
     return true;
 }
@@ -159,7 +247,9 @@ static struct ident *_declarator_ident(struct ast_declarator *declarator) {
     }
 }
 
-static bool gen_statement(struct state *s, ast_statement_t *stmt) {
+static bool gen_statement(struct state *s, ast_stmt_idx_t idx) {
+    ast_statement_t *stmt = &s->nodes->stmts[idx];
+
     switch (stmt->kind) {
     case Ast_Statement_Return:
         gen_expr(s, stmt->expr);
@@ -171,7 +261,7 @@ static bool gen_statement(struct state *s, ast_statement_t *stmt) {
         gen_expr(s, stmt->expr);
         fprintf(s->f, "cmp $0, %%rax\n");
         size_t end_label = s->label_idx++;
-        if (stmt->arm2 != NULL) {
+        if (stmt->arm2 != AST_NONE) {
             size_t else_label = s->label_idx++;
             fprintf(s->f, "je if_%zu\n", else_label);
             gen_statement(s, stmt->arm1);
@@ -185,7 +275,7 @@ static bool gen_statement(struct state *s, ast_statement_t *stmt) {
         fprintf(s->f, "if_%zu:\n", end_label);
         break;
     case Ast_Statement_Block:
-        gen_block(s, stmt->block);
+        gen_block(s, &s->nodes->blocks[stmt->block]);
         break;
     case Ast_Statement_Expr:
         gen_expr(s, stmt->expr);
@@ -199,7 +289,7 @@ static bool gen_statement(struct state *s, ast_statement_t *stmt) {
 
 static bool gen_declaration(struct state *s, struct ast_declaration *decl) {
     for (size_t i = 0; i < decl->ndeclarators; i++) {
-        if (decl->exprs[i] != NULL) {
+        if (decl->exprs[i] != AST_NONE) {
             gen_expr(s, decl->exprs[i]);
         }
         // TODO: We can avoid the push and just decrement the stack pointer if
@@ -208,13 +298,16 @@ static bool gen_declaration(struct state *s, struct ast_declaration *decl) {
 
         struct ast_declarator *declarator = &decl->declarators[i];
         struct layout *layout = layout_ty(declarator->ty);
+        if (layout == NULL) {
+            fprintf(stderr, "error: '%s' has an incomplete type\n",
+                    ident_to_str(declarator->ident));
+            s->failed = true;
+            return false;
+        }
 
         s->stack_idx += alignment_padding(s->stack_idx, layout->alignment);
 
-        size_t *idx = malloc(sizeof(size_t));
-        *idx = s->stack_idx;
-
-        scope_declare(s->env, declarator->ident, idx);
+        var_table_declare(s->env, declarator->ident, s->stack_idx);
 
         s->stack_idx += layout->size;
     }
@@ -223,41 +316,48 @@ static bool gen_declaration(struct state *s, struct ast_declaration *decl) {
 }
 
 static bool gen_block(struct state *s, ast_block_t *block) {
+    var_table_enter(s->env);
     for (size_t i = 0; i < block->nitems; i++) {
         switch (block->items[i].kind) {
         case Ast_BlockItem_Statement:
-            gen_statement(s, &block->items[i].stmt);
+            gen_statement(s, block->items[i].stmt);
             break;
         case Ast_BlockItem_Declaration:
             gen_declaration(s, &block->items[i].decl);
             break;
         }
     }
+    var_table_leave(s->env);
 
     return true;
 }
 
-static bool gen_function(FILE *f, ast_function_t *func) {
+static bool gen_function(FILE *f, struct var_table *env,
+                         ast_function_t *func) {
     struct state s = {
         .f = f,
-        .env = scope_new(),
         .stack_idx = 8,
+        .env = env,
+        .nodes = &func->nodes,
     };
     fprintf(s.f, " .globl %s\n", ident_to_str(func->ident));
     fprintf(s.f, "%s:\n", ident_to_str(func->ident));
     fprintf(s.f, "pushq %%rbp\n");
     fprintf(s.f, "mov %%rsp, %%rbp\n");
-    return gen_block(&s, &func->block);
-}
+    bool ok = gen_block(&s, &func->block) && !s.failed;
 
-static bool gen_function_iter(void *context, const void *key, void *value) {
-    FILE *f = context;
-    UNUSED(key);
-    return gen_function(f, value);
+    gen_stack_free(&s.work);
+    return ok;
 }
 
 static bool gen_program(FILE *f, ast_program_t *prog) {
-    return map_iter(prog->functions, f, &gen_function_iter);
+    struct var_table env = {0};
+    bool ok = true;
+    for (size_t i = 0; i < prog->nfunctions && ok; i++) {
+        ok = gen_function(f, &env, prog->ordered[i]);
+    }
+    var_table_free(&env);
+    return ok;
 }
 
 bool gen_generate(FILE *f, ast_program_t ast) { return gen_program(f, &ast); }
@@ -1,59 +1,208 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 
+#include "arena.h"
 #include "map.h"
-#include "vec.h"
+#include "map_define.h"
 
 #include "ident.h"
 
+// The table is safe to use from several threads at once. Idents are spread
+// across SHARDS independently locked maps by the top bits of their hash, so
+// threads interning different strings rarely wait on each other. Ids come
+// from a single atomic counter.
+//
+// The idents themselves live in a compact array indexed by id, made of
+// segments which, once allocated, never move. Their strings are packed
+// end-to-end into blocks owned by the shard that interned them.
+
+#define SHARD_BITS 6
+#define SHARDS (1 << SHARD_BITS)
+
+// Segment k of the directory holds FIRST_SEGMENT << k idents, so 32 segments
+// are more than enough for every 32-bit id.
+#define FIRST_SEGMENT_BITS 10
+#define FIRST_SEGMENT (1 << FIRST_SEGMENT_BITS)
+#define SEGMENTS 32
+
+// Strings are copied into blocks of this size, unless they're bigger.
+#define STRING_BLOCK (16 * 1024)
+
 struct ident {
+    // NUL-terminated.
     const char *str;
+    uint32_t len;
+    // ident_hash(str, len).
+    uint32_t hash;
+    // Dense, in order of interning. Index into ident_table.segments.
+    uint32_t id;
+};
+
+// The map's hashes have already matched, so only the length and bytes need
+// comparing.
+static bool ident_key_eq(const struct ident *a, const struct ident *b) {
+    return a->len == b->len && memcmp(a->str, b->str, a->len) == 0;
+}
+
+static uint32_t ident_key_hash(const struct ident *ident) {
+    return ident->hash;
+}
+
+// Keyed by ident, to its id. Lookups use a struct ident on the stack which
+// points at the string being interned.
+MAP_DEFINE(ident_map, struct ident *, uint32_t, ident_key_hash, ident_key_eq)
+
+struct shard {
+    pthread_mutex_t lock;
+    struct ident_map map;
+    // Append-only storage for the shard's strings, which is only written with
+    // the shard locked. Strings are bump-allocated from [strings, strings_end)
+    // without any alignment.
+    struct arena *arena;
+    char *strings;
+    char *strings_end;
 };
 
 struct ident_table {
-    // Same const char* in both map and vec.
-    // Owned by the ident_table.
+    struct shard shards[SHARDS];
 
-    // map[const char*]size_t*
-    struct map *map;
-    // [size_t]struct ident*
-    struct vec *vec;
+    _Atomic uint32_t len;
+    _Atomic(struct ident *) segments[SEGMENTS];
 };
 
 struct ident_table *ident_table_new() {
-    struct ident_table *t = malloc(sizeof(struct ident_table));
-    t->map = map_new(map_key_string);
-    t->vec = vec_new(sizeof(struct ident *));
+    struct ident_table *t = calloc(1, sizeof(struct ident_table));
+    for (size_t i = 0; i < SHARDS; i++) {
+        pthread_mutex_init(&t->shards[i].lock, NULL);
+        t->shards[i].arena = arena_new();
+    }
     return t;
 }
 
 void ident_table_free(struct ident_table *t) {
-    // TODO: free all size_t* and const char*
-
-    map_free(t->map);
-    vec_free(t->vec);
+    for (size_t i = 0; i < SHARDS; i++) {
+        pthread_mutex_destroy(&t->shards[i].lock);
+        ident_map_free(&t->shards[i].map);
+        arena_free(t->shards[i].arena);
+    }
+    for (size_t i = 0; i < SEGMENTS; i++) {
+        free(atomic_load(&t->segments[i]));
+    }
     free(t);
 }
 
-size_t ident_table_len(struct ident_table *t) { return vec_len(t->vec); }
+size_t ident_table_len(struct ident_table *t) { return atomic_load(&t->len); }
 
-struct ident *ident_from_str(struct ident_table *t, const char *str) {
-    // TODO: map_get_or_insert() would probably be faster.
-    size_t *existing_idx = map_get(t->map, str);
-    if (existing_idx != NULL) {
-        return *(struct ident **)vec_get(t->vec, *existing_idx);
+struct map_stats ident_table_stats(struct ident_table *t) {
+    struct map_stats stats = {0};
+    double total = 0;
+    for (size_t i = 0; i < SHARDS; i++) {
+        struct map_stats shard = ident_map_stats(&t->shards[i].map);
+        stats.count += shard.count;
+        stats.capacity += shard.capacity;
+        total += shard.mean_probe * shard.count;
+        if (shard.max_probe > stats.max_probe) {
+            stats.max_probe = shard.max_probe;
+        }
+    }
+    stats.mean_probe = stats.count > 0 ? total / stats.count : 0;
+    return stats;
+}
+
+uint32_t ident_hash(const char *str, size_t len) {
+    return map_hash_string(str, len);
+}
+
+// Finds the segment and the index within it for an id.
+static size_t segment_of(uint32_t id, size_t *index) {
+    uint32_t n = (id >> FIRST_SEGMENT_BITS) + 1;
+    size_t k = 31 - __builtin_clz(n);
+    *index = id - (((size_t)1 << k) - 1) * FIRST_SEGMENT;
+    return k;
+}
+
+// Returns segment k, allocating it if no other thread has yet.
+static struct ident *segment(struct ident_table *t, size_t k) {
+    struct ident *seg = atomic_load(&t->segments[k]);
+    if (seg != NULL) {
+        return seg;
+    }
+
+    struct ident *fresh = malloc(((size_t)FIRST_SEGMENT << k) * sizeof(*fresh));
+    if (atomic_compare_exchange_strong(&t->segments[k], &seg, fresh)) {
+        return fresh;
     }
+    // Another thread beat us to it: seg is now theirs.
+    free(fresh);
+    return seg;
+}
 
-    // TODO: It'd be nice not to be able to put size_t directly in the map
-    // instead of having to malloc().
-    const char *owned = strdup(str);
-    struct ident *ident = malloc(sizeof(struct ident));
-    ident->str = owned;
-    size_t *idx = malloc(sizeof(size_t));
-    *idx = vec_append(t->vec, &ident);
-    map_insert(t->map, ident->str, idx);
+// Copies str into the shard's string blocks, NUL-terminated.
+static const char *copy_string(struct shard *shard, const char *str,
+                               size_t len) {
+    if ((size_t)(shard->strings_end - shard->strings) < len + 1) {
+        size_t size = len + 1 > STRING_BLOCK ? len + 1 : STRING_BLOCK;
+        shard->strings = arena_alloc(shard->arena, size);
+        shard->strings_end = shard->strings + size;
+    }
 
-    return *(struct ident **)vec_get(t->vec, *idx);
+    char *owned = shard->strings;
+    memcpy(owned, str, len);
+    owned[len] = '\0';
+    shard->strings += len + 1;
+    return owned;
+}
+
+struct ident *ident_from_strn(struct ident_table *t, const char *str,
+                              size_t len, uint32_t hash) {
+    struct shard *shard = &t->shards[hash >> (32 - SHARD_BITS)];
+    pthread_mutex_lock(&shard->lock);
+
+    struct ident key = {.str = str, .len = len, .hash = hash};
+    bool inserted;
+    struct ident_map_entry *entry =
+        ident_map_entry(&shard->map, &key, &inserted);
+    if (!inserted) {
+        struct ident *ident = entry->key;
+        pthread_mutex_unlock(&shard->lock);
+        return ident;
+    }
+
+    uint32_t id = atomic_fetch_add(&t->len, 1);
+    size_t index;
+    struct ident *ident = &segment(t, segment_of(id, &index))[index];
+    *ident = (struct ident){
+        .str = copy_string(shard, str, len),
+        .len = len,
+        .hash = hash,
+        .id = id,
+    };
+
+    entry->key = ident;
+    entry->value = id;
+
+    pthread_mutex_unlock(&shard->lock);
+    return ident;
+}
+
+struct ident *ident_from_str(struct ident_table *t, const char *str) {
+    size_t len = strlen(str);
+    return ident_from_strn(t, str, len, ident_hash(str, len));
+}
+
+struct ident *ident_from_ident(struct ident_table *t, struct ident *ident) {
+    return ident_from_strn(t, ident->str, ident->len, ident->hash);
 }
 
 const char *ident_to_str(struct ident *ident) { return ident->str; }
 
+size_t ident_len(struct ident *ident) { return ident->len; }
+
+uint32_t ident_id(struct ident *ident) { return ident->id; }
+
+struct ident *ident_table_get(struct ident_table *t, uint32_t id) {
+    size_t index;
+    struct ident *seg = atomic_load(&t->segments[segment_of(id, &index)]);
+    return &seg[index];
+}
@@ -1,15 +1,40 @@
 #pragma once
 
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "map.h"
+
 struct ident;
+// Interns identifiers. Safe to use from several threads at once. Idents are
+// never freed or moved until the whole table is freed.
 struct ident_table;
 
 struct ident_table *ident_table_new();
 void ident_table_free(struct ident_table *t);
 
 size_t ident_table_len(struct ident_table *t);
+// Probe lengths over all of the table's shards. Not safe to call while other
+// threads are interning.
+struct map_stats ident_table_stats(struct ident_table *t);
+
+// The hash used by the ident table, for ident_from_strn().
+uint32_t ident_hash(const char *str, size_t len);
 
 struct ident *ident_from_str(struct ident_table *t, const char *str);
+// Interns the len bytes at str, which need not be NUL-terminated. hash must be
+// ident_hash(str, len). The string is only copied if it's not yet interned.
+struct ident *ident_from_strn(struct ident_table *t, const char *str,
+                              size_t len, uint32_t hash);
+// Interns an ident from another table, without rehashing it.
+struct ident *ident_from_ident(struct ident_table *t, struct ident *ident);
 const char *ident_to_str(struct ident *ident);
+// Length of the ident's string, excluding the NUL.
+size_t ident_len(struct ident *ident);
+
+// Idents are numbered densely from 0, in the order they were interned. When
+// several threads intern at once, that order is whichever they got the lock
+// in.
+uint32_t ident_id(struct ident *ident);
+struct ident *ident_table_get(struct ident_table *t, uint32_t id);
 
@@ -2,10 +2,11 @@
 
 #include "ident.h"
 #include "layout.h"
-#include "map.h"
 #include "pprint.h"
 #include "ty.h"
-#include "vec.h"
+#include "vec_define.h"
+
+VEC_DEFINE(layout_member_vec, struct layout_member)
 
 size_t alignment_padding(size_t base, size_t alignment) {
     size_t delta = (base % alignment);
@@ -55,13 +56,53 @@ void layout_pprint(struct pprint *pp, struct layout *layout) {
     pprint_newline(pp);
 }
 
+// Adds each member to the lookup, with base added to its offset. Anonymous
+// members' members are added in their place.
+static void layout_construct_lookup(struct layout_member_map *lookup,
+                                    struct layout_member *members,
+                                    size_t nmembers, size_t base) {
+    for (size_t i = 0; i < nmembers; i++) {
+        struct layout_member member = members[i];
+        member.offset += base;
+
+        if (member.ident == NULL) {
+            layout_construct_lookup(lookup, member.layout->members,
+                                    member.layout->nmembers, member.offset);
+        } else {
+            layout_member_map_insert(lookup, member.ident, member);
+        }
+    }
+}
+
+static struct layout *layout_new(char alignment, size_t size,
+                                 struct layout_member_vec *members) {
+    struct layout *layout = malloc(sizeof(struct layout));
+    layout->alignment = alignment;
+    layout->size = size;
+    layout->nmembers = layout_member_vec_into_raw(members, &layout->members);
+    layout->lookup = (struct layout_member_map){0};
+
+    layout_construct_lookup(&layout->lookup, layout->members,
+                            layout->nmembers, 0);
+
+    return layout;
+}
+
+// Cached for types which have no layout, so that they aren't recomputed on
+// every lookup. layout_ty() returns NULL in its place.
+static struct layout incomplete_layout;
+
 static struct layout *layout_ty_struct(struct ty *ty) {
     char alignment = 0;
     size_t size = 0;
 
-    struct vec *members = vec_new(sizeof(struct layout_member));
+    struct layout_member_vec members = {0};
     for (size_t i = 0; i < ty->nmembers; i++) {
         struct layout *layout = layout_ty(ty->members[i].ty);
+        if (layout == NULL) {
+            layout_member_vec_free(&members);
+            return &incomplete_layout;
+        }
 
         size += alignment_padding(size, layout->alignment);
         struct layout_member member = {
@@ -69,7 +110,7 @@ static struct layout *layout_ty_struct(struct ty *ty) {
             .offset = size,
             .layout = layout,
         };
-        vec_append(members, &member);
+        layout_member_vec_push(&members, member);
 
         size += layout->size;
 
@@ -84,29 +125,27 @@ static struct layout *layout_ty_struct(struct ty *ty) {
     // aligned properly.
     size += alignment_padding(size, alignment);
 
-    struct layout *layout = malloc(sizeof(layout));
-    layout->alignment = alignment;
-    layout->size = size;
-    layout->nmembers = vec_into_raw(members, (void **)&layout->members);
-    layout->lookup = map_new(map_key_pointer);
-
-    return layout;
+    return layout_new(alignment, size, &members);
 }
 
 static struct layout *layout_ty_union(struct ty *ty) {
     char alignment = 0;
     size_t size = 0;
 
-    struct vec *members = vec_new(sizeof(struct layout_member));
+    struct layout_member_vec members = {0};
     for (size_t i = 0; i < ty->nmembers; i++) {
         struct layout *layout = layout_ty(ty->members[i].ty);
+        if (layout == NULL) {
+            layout_member_vec_free(&members);
+            return &incomplete_layout;
+        }
 
         struct layout_member member = {
             .ident = ty->members[i].ident,
             .offset = 0,
             .layout = layout,
         };
-        vec_append(members, &member);
+        layout_member_vec_push(&members, member);
 
         // Size the struct to the max size of its members.
         if (layout->size > size) {
@@ -124,51 +163,60 @@ static struct layout *layout_ty_union(struct ty *ty) {
     // aligned properly.
     size += alignment_padding(size, alignment);
 
-    struct layout *layout = malloc(sizeof(layout));
-    layout->alignment = alignment;
-    layout->size = size;
-    layout->nmembers = vec_into_raw(members, (void **)&layout->members);
-    layout->lookup = map_new(map_key_pointer);
-
-    return layout;
+    return layout_new(alignment, size, &members);
 }
 
-static struct layout *layout_basic_ty(enum basic_ty ty) {
-    struct layout *layout = malloc(sizeof(struct layout));
-    layout->nmembers = 0;
-
-    switch (ty) {
-    case BasicTy_Char:
-        layout->alignment = 1;
-        layout->size = 1;
-        break;
-    case BasicTy_ShortInt:
-        layout->alignment = 2;
-        layout->size = 2;
-        break;
-    case BasicTy_Int:
-        layout->alignment = 4;
-        layout->size = 4;
-        break;
-    case BasicTy_LongInt:
-        layout->alignment = 8;
-        layout->size = 8;
-        break;
-    }
+// Types without members have layouts which are shared, rather than each
+// allocating its own.
+static struct layout basic_layouts[] = {
+    [BasicTy_Char] = {.alignment = 1, .size = 1},
+    [BasicTy_ShortInt] = {.alignment = 2, .size = 2},
+    [BasicTy_Int] = {.alignment = 4, .size = 4},
+    [BasicTy_LongInt] = {.alignment = 8, .size = 8},
+};
 
-    return layout;
-}
+static struct layout pointer_layout = {.alignment = 8, .size = 8};
 
-struct layout *layout_ty(struct ty *ty) {
+static struct layout *layout_compute(struct ty *ty) {
     switch (ty->kind) {
     case Ty_Basic:
-        return layout_basic_ty(ty->basic);
+        return &basic_layouts[ty->basic];
+
+    case Ty_Pointer:
+        return &pointer_layout;
 
     case Ty_Struct:
         return layout_ty_struct(ty);
 
     case Ty_Union:
         return layout_ty_union(ty);
+
+    case Ty_Incomplete:
+        return &incomplete_layout;
     }
+    abort();
 }
 
+struct layout *layout_ty(struct ty *ty) {
+    if (ty->layout == NULL) {
+        ty->layout = layout_compute(ty);
+    }
+    if (ty->layout == &incomplete_layout) {
+        return NULL;
+    }
+    return ty->layout;
+}
+
+struct layout_member *layout_lookup(struct layout *layout,
+                                    struct ident *ident) {
+    return layout_member_map_get(&layout->lookup, ident);
+}
+
+void layout_free(struct layout *layout) {
+    if (layout == &incomplete_layout) {
+        return;
+    }
+    free(layout->members);
+    layout_member_map_free(&layout->lookup);
+    free(layout);
+}
@@ -2,12 +2,24 @@
 
 #include <stdlib.h>
 
-#include "map.h"
+#include "ident.h"
+#include "map_define.h"
 #include "pprint.h"
 #include "ty.h"
 
 size_t alignment_padding(size_t base, size_t alignment);
 
+struct layout;
+
+struct layout_member {
+    struct ident *ident;
+    size_t offset;
+    struct layout *layout;
+};
+
+MAP_DEFINE(layout_member_map, struct ident *, struct layout_member,
+           map_hash_ptr, map_eq_ptr)
+
 struct layout {
     char alignment;
     size_t size;
@@ -15,17 +27,20 @@ struct layout {
     struct layout_member *members;
     size_t nmembers;
 
-    // map[struct ident*]struct layout_member*
-    struct map *lookup;
-};
-
-struct layout_member {
-    struct ident *ident;
-    size_t offset;
-    struct layout *layout;
+    // Each member by ident, with its offset from the start of this layout.
+    // Anonymous members' members are inlined into this lookup.
+    struct layout_member_map lookup;
 };
 
+// Computed the first time it's asked for, and kept on ty until the type is
+// freed. Returns NULL if ty is incomplete, as it has no size. That is kept
+// too, so an incomplete type isn't recomputed on every call.
 struct layout *layout_ty(struct ty *ty);
+// Returns NULL if layout has no member ident. Nothing generates member
+// accesses yet, so this is only used by the tests for now.
+struct layout_member *layout_lookup(struct layout *layout,
+                                    struct ident *ident);
+// Frees a struct or union's layout, but not its members' layouts.
+void layout_free(struct layout *layout);
 
 void layout_pprint(struct pprint *pp, struct layout *layout);
-
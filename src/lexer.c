@@ -1,271 +1,189 @@
-#include <ctype.h>
+#include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
 
 #include "ident.h"
 #include "lexer.h"
+#include "scan.h"
 
-static const struct {
-    token_keyword_t keyword;
-    const char *str;
-} keywords[] = {
-    {Keyword_char, "char"},     {Keyword_short, "short"},
-    {Keyword_int, "int"},       {Keyword_long, "long"},
-    {Keyword_return, "return"}, {Keyword_if, "if"},
-    {Keyword_else, "else"},     {Keyword_struct, "struct"},
-    {Keyword_union, "union"},   {Keyword_const, "const"},
-};
+// Generated from tools/lexgen.c: lex_class maps each byte to its character
+// class, and lex_next is a DFA over those classes which recognises a single
+// token, keywords and punctuators included. lex_accept says what token (if
+// any) a run ending in each state is.
+#include "lexer_tables.h"
 
-static bool lookup_keyword(const char *str, size_t len, token_keyword_t *out) {
-    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
-        if (strlen(keywords[i].str) == len &&
-            strncmp(str, keywords[i].str, len) == 0) {
-            *out = keywords[i].keyword;
-            return true;
-        }
-    }
-    return false;
-}
-
-static const char *keyword_as_string(token_keyword_t keyword) {
-    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
-        if (keywords[i].keyword == keyword) {
-            return keywords[i].str;
-        }
-    }
-    return "UNKNOWN_KEYWORD";
-}
-
-static bool iswhitespace(char c) { return c == ' ' || c == '\t' || c == '\n'; }
-
-static bool isnondigit(char c) { return c == '_' || isalpha(c); }
-
-static void advance(lexer_state_t *state) {
-    char prev = state->unlexed[0];
-
-    state->unlexed++;
-    state->character++;
-
-    if (prev == '\n') {
-        state->line++;
-        state->character = 0;
-    }
-}
-
-static char peek(lexer_state_t *state, size_t i) { return state->unlexed[i]; }
+static const char unexpected_character[] = "unexpected character";
 
 static token_span_t span(lexer_state_t *state, const char *start,
-                         const char *end) {
-    return (token_span_t){
-        .start = start,
-        .end = end,
-        .line = state->line,
-        .character = state->character,
-    };
-}
-
-static bool lexer_constant(lexer_state_t *state, token_t *next) {
-    const char *start = state->unlexed;
-    advance(state);
-
-    while (true) {
-        char c = state->unlexed[0];
-
-        if (c == '\0') {
-            return false;
-        }
-
-        if (isdigit(c)) {
-            advance(state);
-        } else {
-            size_t len = state->unlexed - start;
-            char *str = (char *)malloc(len + 1);
-            strlcpy(str, start, len + 1);
-
-            *next = (token_t){.discrim = Token_Constant,
-                              .str = str,
-                              .span = span(state, start, state->unlexed - 1)};
-            return true;
-        }
-    }
-}
-
-static bool lexer_identifier_or_keyword(lexer_state_t *state, token_t *next) {
-    const char *start = state->unlexed;
-    advance(state);
-
-    while (true) {
-        char c = state->unlexed[0];
-
-        if (c == '\0') {
-            return false;
-        }
-
-        if (isnondigit(c) || isdigit(c)) {
-            advance(state);
-        } else {
-            size_t len = state->unlexed - start;
-
-            token_keyword_t keyword;
-            if (lookup_keyword(start, len, &keyword)) {
-                *next = (token_t){
-                    .discrim = Token_Keyword,
-                    .keyword = keyword,
-                    .span = span(state, start, state->unlexed - 1),
-                };
-                return true;
-            } else {
-                char *str = (char *)malloc(len + 1);
-                strlcpy(str, start, len + 1);
-
-                // TODO: ident_from_str does strdup(). Does it need to?
-                struct ident *ident = ident_from_str(state->idents, str);
-
-                *next =
-                    (token_t){.discrim = Token_Identifier,
-                              .ident = ident,
-                              .span = span(state, start, state->unlexed - 1)};
-                return true;
-            }
-        }
-    }
+                         size_t len) {
+    return (token_span_t){.offset = start - state->prog, .len = len};
 }
 
-static bool ispunctuation(char c) {
-    return c == '(' || c == ')' || c == '{' || c == '}' || c == '[' ||
-           c == ']' || c == ';' || c == '+' || c == '-' || c == '*' ||
-           c == '/' || c == '=' || c == '>' || c == '<' || c == '!' ||
-           c == '&' || c == ',' || c == '.';
+const char *lexer_token_text(const char *prog, token_t *tok) {
+    return prog + tok->span.offset;
 }
 
-static struct {
-    token_punctuator_t punctuator;
-    const char *str;
-    size_t len;
-} punctuators[] = {
-    {Punctuator_Equal, "==", 2},
-    {Punctuator_NotEqual, "!=", 2},
-    {Punctuator_GreaterThanEqual, ">=", 2},
-    {Punctuator_LessThanEqual, "<=", 2},
-    {Punctuator_PlusAssign, "+=", 2},
-    {Punctuator_MinusAssign, "-=", 2},
-    {Punctuator_AsteriskAssign, "*=", 2},
-    {Punctuator_ForwardSlashAssign, "/=", 2},
-    {Punctuator_Arrow, "->", 2},
-
-    {Punctuator_Assign, "=", 1},
-    {Punctuator_Ampersand, "&", 1},
-    {Punctuator_GreaterThan, ">", 1},
-    {Punctuator_LessThan, "<", 1},
-    {Punctuator_OpenBrace, "{", 1},
-    {Punctuator_CloseBrace, "}", 1},
-    {Punctuator_OpenParen, "(", 1},
-    {Punctuator_CloseParen, ")", 1},
-    {Punctuator_OpenBracket, "[", 1},
-    {Punctuator_CloseBracket, "]", 1},
-    {Punctuator_Semicolon, ";", 1},
-    {Punctuator_Comma, ",", 1},
-    {Punctuator_Plus, "+", 1},
-    {Punctuator_Minus, "-", 1},
-    {Punctuator_Asterisk, "*", 1},
-    {Punctuator_ForwardSlash, "/", 1},
-    {Punctuator_Period, ".", 1},
-};
-
-static const char *punctuator_as_string(token_punctuator_t p) {
-    for (size_t i = 0; i < sizeof(punctuators) / sizeof(punctuators[0]); i++) {
-        if (punctuators[i].punctuator == p) {
-            return punctuators[i].str;
-        }
-    }
-    return "UNKNOWN_PUNCTUATOR";
-}
-
-static bool lexer_punctuation(lexer_state_t *state, token_t *next) {
-    const char *start = state->unlexed;
-
-    char c[2] = {peek(state, 0), peek(state, 1)};
-    for (size_t i = 0; i < sizeof(punctuators) / sizeof(punctuators[0]); i++) {
-        bool match = true;
-        for (size_t j = 0; j < punctuators[i].len; j++) {
-            if (c[j] != punctuators[i].str[j]) {
-                match = false;
-                break;
-            }
-        }
-
-        if (!match) {
-            continue;
-        }
-
-        *next =
-            (token_t){.discrim = Token_Punctuator,
-                      .punctuator = punctuators[i].punctuator,
-                      .span = span(state, start, start + punctuators[i].len)};
-
-        for (size_t j = 0; j < punctuators[i].len; j++) {
-            advance(state);
-        }
-
-        return true;
-    }
-    printf("lexer: unexpected punctuator\n");
-    exit(-1);
-}
-
-void lexer_print_token(FILE *f, token_t tok) {
+void lexer_print_token(FILE *f, const char *prog, token_t tok) {
     switch (tok.discrim) {
     case Token_Keyword:
         fprintf(f, "Token_Keyword    { .keyword = %s }\n",
-                keyword_as_string(tok.keyword));
+                lex_keyword_names[tok.keyword]);
         break;
     case Token_Identifier:
         fprintf(f, "Token_Identifier { .str = \"%s\" }\n",
                 ident_to_str(tok.ident));
         break;
     case Token_Constant:
-        fprintf(f, "Token_Constant   { .str = \"%s\" }\n", tok.str);
+        fprintf(f, "Token_Constant   { .str = \"%.*s\" }\n", (int)tok.span.len,
+                lexer_token_text(prog, &tok));
         break;
     case Token_Punctuator:
         fprintf(f, "Token_Punctuator { .punctuator = %s }\n",
-                punctuator_as_string(tok.punctuator));
+                lex_punctuator_names[tok.punctuator]);
+        break;
+    case Token_Eof:
+        fprintf(f, "Token_Eof\n");
         break;
     }
 }
 
-lexer_state_t lexer_new(struct ident_table *idents, const char *prog) {
+lexer_state_t lexer_new(struct ident_table *idents, const char *prog,
+                        size_t len) {
+    return lexer_new_range(idents, prog, 0, len);
+}
+
+lexer_state_t lexer_new_range(struct ident_table *idents, const char *prog,
+                              size_t begin, size_t end) {
+    // Spans are 32-bit offsets, so anything larger would wrap.
+    assert(begin <= end && end <= UINT32_MAX);
+
     return (lexer_state_t){
         .idents = idents,
 
         .prog = prog,
-        .unlexed = prog,
+        .unlexed = prog + begin,
+        .end = prog + end,
+        .error = NULL,
 
-        .line = 0,
-        .character = 0,
+        .scan = scan_select(),
     };
 }
 
+// Skips the rest of a block comment, returning NULL if it's unterminated.
+static const char *skip_block_comment(lexer_state_t *state, const char *p) {
+    p = state->scan->comment_end(p, state->end);
+    return p == state->end ? NULL : p + 2;
+}
+
+// Runs the DFA from state s over [p, end) for as long as there are
+// transitions, returning the final state. Maximal munch: every prefix of a
+// punctuator other than "!" is itself a token, so we never need to back up.
+// Stops early in LEX_IDENT, whose run is left to the caller's scan kernel.
+static uint8_t run_dfa(uint8_t s, const char **p, const char *end) {
+    while (*p < end && s != LEX_IDENT) {
+        uint8_t n = lex_next[s][lex_class[(unsigned char)**p]];
+        if (n == LEX_DEAD) {
+            break;
+        }
+        s = n;
+        (*p)++;
+    }
+    return s;
+}
+
 bool lexer_next_token(lexer_state_t *state, token_t *next) {
-    while (true) {
-        char c = state->unlexed[0];
+    const char *p = state->unlexed;
+    const char *end = state->end;
 
-        if (c == '\0') {
-            return false;
+    while (p < end) {
+        const char *start = p;
+
+        // The first byte decides what kind of token this is. The long runs
+        // (whitespace, identifiers and constants) are then found with the
+        // scanning kernels, and everything else with the DFA.
+        uint8_t s = lex_next[LEX_START][lex_class[(unsigned char)*p++]];
+
+        switch (lex_accept[s].kind) {
+        case Lex_Whitespace:
+            p = state->scan->whitespace(start, end);
+            continue;
+
+        case Lex_Constant:
+            p = state->scan->digits(p, end);
+            state->unlexed = p;
+            *next = (token_t){.discrim = Token_Constant,
+                              .span = span(state, start, p - start)};
+            return true;
+
+        case Lex_Identifier:
+        case Lex_Keyword: {
+            // Keywords are accepting states of the DFA, so it runs for as
+            // long as the run could still be one. Past that, the rest of the
+            // identifier is found with the scanning kernel.
+            s = run_dfa(s, &p, end);
+            if (s == LEX_IDENT) {
+                p = state->scan->ident(p, end);
+            }
+            size_t len = p - start;
+            state->unlexed = p;
+
+            if (lex_accept[s].kind == Lex_Keyword) {
+                *next = (token_t){.discrim = Token_Keyword,
+                                  .keyword = lex_accept[s].value,
+                                  .span = span(state, start, len)};
+                return true;
+            }
+
+            // Interned straight from the source: the string is only copied
+            // the first time we see it.
+            struct ident *ident = ident_from_strn(state->idents, start, len,
+                                                  ident_hash(start, len));
+            *next = (token_t){.discrim = Token_Identifier,
+                              .ident = ident,
+                              .span = span(state, start, len)};
+            return true;
         }
 
-        if (iswhitespace(c)) {
-            advance(state);
-        } else if (isdigit(c)) {
-            return lexer_constant(state, next);
-        } else if (isnondigit(c)) {
-            return lexer_identifier_or_keyword(state, next);
-        } else if (ispunctuation(c)) {
-            return lexer_punctuation(state, next);
-        } else {
-            printf("lexer: unexpected char: %c\n", c);
+        default:
+            s = run_dfa(s, &p, end);
+            break;
+        }
+
+        switch (lex_accept[s].kind) {
+        case Lex_Punctuator:
+            state->unlexed = p;
+            *next = (token_t){.discrim = Token_Punctuator,
+                              .punctuator = lex_accept[s].value,
+                              .span = span(state, start, p - start)};
+            return true;
+        case Lex_LineComment:
+            p = state->scan->newline(p, end);
+            continue;
+        case Lex_BlockComment:
+            p = skip_block_comment(state, p);
+            if (p == NULL) {
+                state->unlexed = start;
+                state->error = "unterminated comment";
+                return false;
+            }
+            continue;
+        default:
+            state->unlexed = start;
+            state->error = unexpected_character;
             return false;
         }
     }
+
+    state->unlexed = p;
+    return false;
+}
+
+bool lexer_skip_error(lexer_state_t *state) {
+    if (state->error != unexpected_character) {
+        return false;
+    }
+    state->unlexed++;
+    state->error = NULL;
+    return true;
 }
@@ -1,14 +1,16 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+// Tokens don't own any text: their span refers back into the (immutable)
+// source buffer instead. Lines and columns aren't tracked while lexing, see
+// lines.h.
 typedef struct {
-    unsigned int line;
-    unsigned int character;
-
-    const char *start;
-    const char *end;
+    // Byte offset of the start of the token in the source, and its length.
+    uint32_t offset;
+    uint32_t len;
 } token_span_t;
 
 typedef enum {
@@ -16,7 +18,9 @@ typedef enum {
     Token_Identifier,
     Token_Constant,
     // Token_StringLiteral,
-    Token_Punctuator
+    Token_Punctuator,
+    // Never returned by lexer_next_token(). Terminates a token buffer.
+    Token_Eof,
 } token_discrim_t;
 
 typedef enum {
@@ -65,6 +69,9 @@ typedef enum {
     Punctuator_CloseBrace,
     Punctuator_OpenBracket,
     Punctuator_CloseBracket,
+
+    // Not a punctuator: the number of them, for tables indexed by punctuator.
+    Punctuator_Count,
 } token_punctuator_t;
 
 typedef struct {
@@ -74,8 +81,7 @@ typedef struct {
         token_keyword_t keyword;
         // Token_Identifier
         struct ident *ident;
-        // Token_Constant:
-        const char *str;
+        // Token_Constant has no payload: its text is its span.
         // Token_Punctuator
         token_punctuator_t punctuator;
     };
@@ -87,13 +93,33 @@ typedef struct {
     struct ident_table *idents;
 
     const char *prog;
+    // After an error, points at the start of the offending token.
     const char *unlexed;
+    // One past the last byte to lex. prog need not be NUL-terminated.
+    const char *end;
+    // Set if lexer_next_token() returned false because of an error, rather
+    // than because it reached the end.
+    const char *error;
 
-    unsigned int line;
-    unsigned int character;
+    // Kernels for skipping over runs of whitespace, identifiers, etc.
+    const struct scan_kernels *scan;
 } lexer_state_t;
 
-lexer_state_t lexer_new(struct ident_table *idents, const char *prog);
+// prog must be at most UINT32_MAX bytes, so that spans can hold its offsets.
+lexer_state_t lexer_new(struct ident_table *idents, const char *prog,
+                        size_t len);
+// Lexes only bytes [begin, end) of prog, which must start between tokens.
+// Spans are still relative to prog.
+lexer_state_t lexer_new_range(struct ident_table *idents, const char *prog,
+                              size_t begin, size_t end);
 bool lexer_next_token(lexer_state_t *state, token_t *next);
+// After lexer_next_token() has failed on a character which can't start a
+// token, moves past the character so that lexing can carry on. Returns false
+// if the error can't be skipped: an unterminated comment runs to the end.
+bool lexer_skip_error(lexer_state_t *state);
+
+// Returns a pointer to the token's text in prog. The text is span.len bytes
+// long and is not NUL-terminated.
+const char *lexer_token_text(const char *prog, token_t *tok);
 
-void lexer_print_token(FILE *f, token_t tok);
+void lexer_print_token(FILE *f, const char *prog, token_t tok);
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lines.h"
+#include "scan.h"
+#include "vec.h"
+
+struct lines {
+    // Offset of the first byte of each line. starts[0] is always 0.
+    uint32_t *starts;
+    size_t len;
+};
+
+struct lines *lines_new(const char *prog, size_t len) {
+    const struct scan_kernels *scan = scan_select();
+    const char *end = prog + len;
+
+    struct vec *starts = vec_new(sizeof(uint32_t));
+    uint32_t start = 0;
+    vec_append(starts, &start);
+    for (const char *p = scan->newline(prog, end); p < end;
+         p = scan->newline(p + 1, end)) {
+        start = p + 1 - prog;
+        vec_append(starts, &start);
+    }
+
+    struct lines *lines = malloc(sizeof(struct lines));
+    lines->len = vec_into_raw(starts, (void **)&lines->starts);
+    return lines;
+}
+
+void lines_free(struct lines *lines) {
+    free(lines->starts);
+    free(lines);
+}
+
+size_t lines_len(struct lines *lines) { return lines->len; }
+
+void lines_position(struct lines *lines, uint32_t offset, unsigned int *line,
+                    unsigned int *column) {
+    // Find the last line which starts at or before offset.
+    size_t lo = 0, hi = lines->len;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (lines->starts[mid] <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *line = lo;
+    *column = offset - lines->starts[lo];
+}
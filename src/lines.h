@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Tokens only record their offset into the source. Lines and columns are
+// recovered from the offset when they're needed (e.g. for a diagnostic),
+// using an index of where each line starts.
+struct lines;
+
+struct lines *lines_new(const char *prog, size_t len);
+void lines_free(struct lines *lines);
+
+size_t lines_len(struct lines *lines);
+
+// Finds the zero-based line and column of the byte at offset.
+void lines_position(struct lines *lines, uint32_t offset, unsigned int *line,
+                    unsigned int *column);
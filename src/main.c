@@ -1,68 +1,295 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "ast.h"
 #include "diag.h"
 #include "gen.h"
 #include "ident.h"
 #include "lexer.h"
+#include "lines.h"
 #include "parser.h"
+#include "pprint.h"
+#include "tokens.h"
+#include "ty.h"
 #include "tycheck.h"
 
-int main() {
-    const char *prog = "int main() {\n"
-                       "    long a = 1, b;\n"
-                       "    b = 2;\n"
-                       "    long c = a + b;\n"
-                       "    short d = 0;\n"
-                       "    struct { short a; int b; char c; } f;\n"
-                       "    int g = 0;\n"
-                       "    union { short a; int b; char c; }; \n"
-                       "    return c;\n"
-                       "}\n"
-                       "\n";
-
-    // lexer_state_t state = lexer_new(prog);
-    // token_t token;
-    // while (lexer_next_token(&state, &token)) {
-    //     lexer_print_token(token);
-    // }
-    // return 0;
+#define OUTPUT_BUFFER_SIZE (1 << 16)
 
+enum emit {
+    Emit_Asm,
+    Emit_Ast,
+    // The name of each function, one per line. Bodies aren't parsed.
+    Emit_Symbols,
+};
+
+struct options {
+    const char *input;
+    // Optional. Derived from the input if not given. "-" is stdout.
+    const char *output;
+    enum emit emit;
+    // Number of threads to lex, and parse function bodies, with. Only large
+    // inputs are split.
+    size_t jobs;
+    struct parser_options parser;
+};
+
+// A read-only view of the input file. The buffer is not NUL-terminated.
+struct input {
+    const char *buf;
+    size_t len;
+};
+
+static void usage(FILE *f) {
+    fprintf(f, "usage: ycc [-S] [--emit=asm|ast|symbols] [-j <n>] "
+               "[--max-depth <n>] [-o <output>] <input.c>\n");
+}
+
+static bool parse_args(int argc, char **argv, struct options *opts) {
+    *opts = (struct options){.emit = Emit_Asm, .jobs = 1};
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "-S") == 0 || strcmp(arg, "--emit=asm") == 0) {
+            opts->emit = Emit_Asm;
+        } else if (strcmp(arg, "--emit=ast") == 0) {
+            opts->emit = Emit_Ast;
+        } else if (strcmp(arg, "--emit=symbols") == 0) {
+            opts->emit = Emit_Symbols;
+        } else if (strcmp(arg, "-o") == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "error: -o requires an argument\n");
+                return false;
+            }
+            opts->output = argv[i];
+        } else if (strcmp(arg, "-j") == 0) {
+            char *end;
+            if (++i == argc ||
+                (opts->jobs = strtoul(argv[i], &end, 10)) == 0 || *end) {
+                fprintf(stderr, "error: -j requires a number of threads\n");
+                return false;
+            }
+        } else if (strcmp(arg, "--max-depth") == 0) {
+            char *end;
+            if (++i == argc ||
+                (opts->parser.max_depth = strtoul(argv[i], &end, 10)) == 0 ||
+                *end) {
+                fprintf(stderr, "error: --max-depth requires a number\n");
+                return false;
+            }
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            fprintf(stderr, "error: unknown option: %s\n", arg);
+            return false;
+        } else if (opts->input != NULL) {
+            fprintf(stderr, "error: multiple input files\n");
+            return false;
+        } else {
+            opts->input = arg;
+        }
+    }
+
+    if (opts->input == NULL) {
+        fprintf(stderr, "error: no input file\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Like cc -S, writes foo.s into the current directory for an input of
+// some/path/foo.c. Returns NULL if we should write to stdout.
+static char *default_output(struct options *opts) {
+    if (opts->emit != Emit_Asm) {
+        return NULL;
+    }
+
+    const char *base = strrchr(opts->input, '/');
+    base = (base == NULL) ? opts->input : base + 1;
+
+    size_t len = strlen(base);
+    const char *ext = strrchr(base, '.');
+    if (ext != NULL && ext != base) {
+        len = ext - base;
+    }
+
+    char *output = malloc(len + 3);
+    memcpy(output, base, len);
+    memcpy(output + len, ".s", 3);
+    return output;
+}
+
+// Maps the input read-only. The lexer works directly on the mapping, so the
+// source is never copied.
+static bool input_map(const char *path, struct input *in) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "error: opening %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "error: stat %s: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    // Token spans are 32-bit offsets into the input.
+    if ((uintmax_t)st.st_size > UINT32_MAX) {
+        fprintf(stderr, "error: %s is too large: inputs must be under 4 GiB\n",
+                path);
+        close(fd);
+        return false;
+    }
+
+    // mmap() doesn't allow empty mappings.
+    if (st.st_size == 0) {
+        close(fd);
+        *in = (struct input){.buf = "", .len = 0};
+        return true;
+    }
+
+    void *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "error: mapping %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    *in = (struct input){.buf = buf, .len = st.st_size};
+    return true;
+}
+
+static void input_unmap(struct input *in) {
+    if (in->len > 0) {
+        munmap((void *)in->buf, in->len);
+    }
+}
+
+static void print_errors(struct input *in, struct diags *diags) {
+    // Only needed for diagnostics, so only built when there's an error.
+    struct lines *lines = lines_new(in->buf, in->len);
+    diags_print(in->buf, in->len, lines, diags);
+    lines_free(lines);
+}
+
+static int compile(struct options *opts, struct input *in, FILE *out) {
     struct ident_table *idents = ident_table_new();
 
+    struct tokens *tokens =
+        tokens_lex_parallel(idents, in->buf, in->len, opts->jobs);
+
+    // Listing symbols doesn't need the bodies, so they're skipped.
+    opts->parser.lazy_bodies = opts->emit == Emit_Symbols;
+    opts->parser.jobs = opts->jobs;
+    // Report every error in one run.
+    struct diags diags = {0};
+    opts->parser.diags = &diags;
+
     ast_program_t program;
-    parse_result_t result = parser_parse(idents, prog, &program);
+    parse_result_t result =
+        parser_parse_tokens(idents, in->buf, tokens, &opts->parser, &program);
+    // Skipped bodies are parsed from the tokens, so they're kept until the
+    // program is done with. Otherwise they aren't needed any more.
+    if (!opts->parser.lazy_bodies || result.kind == Parse_Result_Error) {
+        tokens_free(tokens);
+        tokens = NULL;
+    }
     if (result.kind == Parse_Result_Error) {
-        diag_print(prog, &result.diag);
-        return -1;
+        print_errors(in, &diags);
+        diags_free(&diags);
+        ident_table_free(idents);
+        return EXIT_FAILURE;
     }
 
-    struct tycheck *tyc = tycheck_new();
-    tycheck_check(tyc, &program);
-    tycheck_free(tyc);
+    int status = EXIT_SUCCESS;
+    switch (opts->emit) {
+    case Emit_Ast: {
+        struct pprint *pp = pprint_new(out);
+        ast_pprint_program(pp, &program);
+        pprint_free(pp);
+        break;
+    }
 
-    printf("---\n\n");
-    printf("Source:\n");
-    printf("%s\n", prog);
+    case Emit_Asm: {
+        struct ty_table *types = ty_table_new();
+        struct tycheck *tyc = tycheck_new(types);
+        tycheck_check(tyc, &program);
+        tycheck_free(tyc);
 
-    printf("---\n\n");
-    printf("AST:\n");
+        if (!gen_generate(out, program)) {
+            status = EXIT_FAILURE;
+        }
+        ty_table_free(types);
+        break;
+    }
 
-    struct pprint *pp = pprint_new(stdout);
-    ast_pprint_program(pp, &program);
-    pprint_free(pp);
+    case Emit_Symbols:
+        for (size_t i = 0; i < program.nfunctions; i++) {
+            fprintf(out, "%s\n", ident_to_str(program.ordered[i]->ident));
+        }
+        break;
+    }
+
+    if (tokens != NULL) {
+        tokens_free(tokens);
+    }
+    ast_program_free(&program);
+    diags_free(&diags);
+    ident_table_free(idents);
+    return status;
+}
 
-    printf("---\n\n");
-    printf("ASM:\n");
-    gen_generate(stdout, program);
+int main(int argc, char **argv) {
+    struct options opts;
+    if (!parse_args(argc, argv, &opts)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    char *derived = NULL;
+    if (opts.output == NULL) {
+        opts.output = derived = default_output(&opts);
+    }
 
-    FILE *f = fopen("out.s", "w");
-    if (f == NULL) {
-        printf("error: opening out.s\n");
-        return -1;
+    struct input in;
+    if (!input_map(opts.input, &in)) {
+        free(derived);
+        return EXIT_FAILURE;
     }
-    gen_generate(f, program);
-    fclose(f);
 
-    return 0;
+    FILE *out = stdout;
+    if (opts.output != NULL && strcmp(opts.output, "-") != 0) {
+        out = fopen(opts.output, "w");
+        if (out == NULL) {
+            fprintf(stderr, "error: opening %s: %s\n", opts.output,
+                    strerror(errno));
+            input_unmap(&in);
+            free(derived);
+            return EXIT_FAILURE;
+        }
+    }
+    setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    int status = compile(&opts, &in, out);
+
+    if (out != stdout) {
+        fclose(out);
+        if (status != EXIT_SUCCESS) {
+            remove(opts.output);
+        }
+    }
+
+    input_unmap(&in);
+    free(derived);
+
+    return status;
 }
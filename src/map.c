@@ -4,17 +4,20 @@
 #include <string.h>
 
 #include "map.h"
+#include "map_define.h"
 
-#define TOMBSTONE ((void *)-1)
+static uint32_t string_key_hasher(const void *key) {
+    const char *str = key;
+    return map_hash_bytes(str, strlen(str));
+}
 
 static uint32_t string_key_fnv_hasher(const void *key) {
     const char *str = key;
-    uint32_t hash = 2166136261;
-    for (; *str; str++) {
-        hash ^= *str;
-        hash *= 16777619;
-    }
-    return hash;
+    return map_hash_bytes_fnv(str, strlen(str));
+}
+
+uint32_t map_hash_string(const char *str, size_t len) {
+    return map_hash_bytes(str, len);
 }
 
 static bool string_key_eq(const void *key1, const void *key2) {
@@ -22,146 +25,263 @@ static bool string_key_eq(const void *key1, const void *key2) {
 }
 
 struct map_key *map_key_string = &(struct map_key){
+    .hasher = string_key_hasher,
+    .eq = string_key_eq,
+};
+
+struct map_key *map_key_string_fnv = &(struct map_key){
     .hasher = string_key_fnv_hasher,
     .eq = string_key_eq,
 };
 
+static uint32_t pointer_key_hasher(const void *key) {
+    return map_hash_ptr(key);
+}
+
 static uint32_t pointer_key_fnv_hasher(const void *key) {
-    // NOTE: Casting pointer to integer is implementation defined.
-    const char *ptr = (const char *)&key;
-    uint32_t hash = 2166136261;
-    for (size_t i = 0; i < sizeof(const void *); i++) {
-        hash ^= *(ptr + i);
-        hash *= 16777619;
-    }
-    return hash;
+    return map_hash_ptr_fnv(key);
 }
 
 static bool pointer_key_eq(const void *key1, const void *key2) {
-    return key1 == key2;
+    return map_eq_ptr(key1, key2);
 }
 
 struct map_key *map_key_pointer = &(struct map_key){
-    .hasher = pointer_key_fnv_hasher,
+    .hasher = pointer_key_hasher,
     .eq = pointer_key_eq,
 };
 
-struct entry {
-    const void *key;
-    void *ptr;
+struct map_key *map_key_pointer_fnv = &(struct map_key){
+    .hasher = pointer_key_fnv_hasher,
+    .eq = pointer_key_eq,
 };
 
+// The map is an open-addressing hash table in the style of Abseil's
+// SwissTable. Alongside each slot is a control byte, which is either EMPTY,
+// DELETED (a tombstone) or holds the low 7 bits of the hash of the slot's key.
+// Lookups probe a group of MAP_GROUP_SIZE control bytes at a time, comparing
+// them all against the hash fragment at once, and only call the key's eq
+// function on slots whose fragment (and stored hash) match.
+
+#define NOT_FOUND MAP_NOT_FOUND
+
 struct map {
     struct map_key *key;
-    struct entry *entries;
+
+    // capacity + MAP_GROUP_SIZE control bytes. The first MAP_GROUP_SIZE
+    // control bytes are mirrored after the last one, so a group can be loaded
+    // starting from any slot without wrapping around.
+    int8_t *ctrl;
+    struct map_entry *entries;
+    // Full hash of each entry's key, so that resizing doesn't need to rehash
+    // and so that most mismatches are rejected without calling eq.
+    uint32_t *hashes;
+
     size_t count;
+    // Number of EMPTY slots that can be filled before we have to resize.
+    size_t growth_left;
+    // Always a power of two, and at least MAP_MIN_CAPACITY.
     size_t capacity;
 };
 
+// The group matching and probing helpers are shared with MAP_DEFINE, in
+// map_define.h.
+
+static void set_ctrl(struct map *m, size_t i, int8_t ctrl) {
+    map_set_ctrl(m->ctrl, m->capacity, i, ctrl);
+}
+
+static size_t find_insert_slot(struct map *m, uint32_t hash) {
+    return map_find_insert_slot(m->ctrl, m->capacity, hash);
+}
+
+static void alloc_table(struct map *m, size_t capacity) {
+    m->capacity = capacity;
+    m->count = 0;
+    m->growth_left = map_max_load(capacity);
+    m->entries = malloc(capacity * sizeof(struct map_entry));
+    m->hashes = malloc(capacity * sizeof(uint32_t));
+    m->ctrl = map_ctrl_new(capacity);
+}
+
 struct map *map_new(struct map_key *key) {
     struct map *m = calloc(1, sizeof(struct map));
-    m->entries = calloc(16, sizeof(struct entry));
-    m->count = 0;
-    m->capacity = 16;
     m->key = key;
+    alloc_table(m, MAP_MIN_CAPACITY);
     return m;
 }
 
 void map_free(struct map *m) {
+    free(m->ctrl);
     free(m->entries);
+    free(m->hashes);
     free(m);
 }
 
-static bool overloaded(struct map *m) {
-    // 0.5 load factor
-    return m->count > (m->capacity - 1);
+// Returns the index of the entry whose key has the given hash and satisfies
+// eq(context, key), or NOT_FOUND.
+static size_t find_by(struct map *m, uint32_t hash,
+                      bool (*eq)(const void *context, const void *key),
+                      const void *context) {
+    int8_t fragment = map_h2(hash);
+    for (struct map_probe p = map_probe_start(m->capacity, hash);;
+         map_probe_next(&p)) {
+        const int8_t *group = m->ctrl + p.pos;
+
+        map_group_mask_t match = map_group_match(group, fragment);
+        while (match) {
+            size_t i = (p.pos + __builtin_ctz(match)) & p.mask;
+            if (m->hashes[i] == hash && eq(context, m->entries[i].key)) {
+                return i;
+            }
+            match &= match - 1;
+        }
+
+        // The key would have been placed in this group if it had an EMPTY
+        // slot, so it can't be any further along the probe sequence.
+        if (map_group_match_empty(group)) {
+            return NOT_FOUND;
+        }
+    }
 }
 
-static size_t entry(struct map *m, const void *key) {
-    return m->key->hasher(key) & (m->capacity - 1);
+struct find_context {
+    struct map *m;
+    const void *key;
+};
+
+static bool find_eq(const void *context, const void *key) {
+    const struct find_context *c = context;
+    return c->m->key->eq(key, c->key);
 }
 
-static bool key_eq(struct map *m, const void *key1, const void *key2) {
-    if (key1 == NULL || key1 == TOMBSTONE || key2 == NULL ||
-        key2 == TOMBSTONE) {
-        return false;
-    }
-    return m->key->eq(key1, key2);
+// Returns the index of the entry for key, or NOT_FOUND.
+static size_t find(struct map *m, const void *key, uint32_t hash) {
+    struct find_context context = {.m = m, .key = key};
+    return find_by(m, hash, find_eq, &context);
 }
 
+// Rebuilds the table so that it has room for at least one more entry,
+// dropping all tombstones. Entries are moved by their stored hash, without
+// calling the hasher or eq.
 static void resize(struct map *m) {
-    struct entry *old_entries = m->entries;
+    int8_t *old_ctrl = m->ctrl;
+    struct map_entry *old_entries = m->entries;
+    uint32_t *old_hashes = m->hashes;
     size_t old_capacity = m->capacity;
+    size_t count = m->count;
 
-    m->count = 0; // everything will be re-inserted
-    m->capacity *= 2;
-    m->entries = calloc(m->capacity, sizeof(struct entry));
+    // If the table is mostly tombstones, rebuilding it at the same size is
+    // enough.
+    size_t capacity = old_capacity;
+    if (count + 1 > map_max_load(capacity) / 2) {
+        capacity *= 2;
+    }
+    alloc_table(m, capacity);
 
     for (size_t i = 0; i < old_capacity; i++) {
-        if (old_entries[i].key != NULL && old_entries[i].key != TOMBSTONE) {
-            map_insert(m, old_entries[i].key, old_entries[i].ptr);
+        if (old_ctrl[i] < 0) {
+            continue;
         }
+
+        uint32_t hash = old_hashes[i];
+        size_t j = find_insert_slot(m, hash);
+        set_ctrl(m, j, map_h2(hash));
+        m->entries[j] = old_entries[i];
+        m->hashes[j] = hash;
     }
+    m->count = count;
+    m->growth_left -= count;
 
+    free(old_ctrl);
     free(old_entries);
+    free(old_hashes);
 }
 
-void map_insert(struct map *m, const void *key, void *ptr) {
-    if (overloaded(m)) {
+// Reserves a slot for a key which isn't in the map, returning its index.
+static size_t prepare_insert(struct map *m, uint32_t hash) {
+    size_t i = find_insert_slot(m, hash);
+
+    // Reusing a tombstone doesn't use up an EMPTY slot.
+    if (m->growth_left == 0 && m->ctrl[i] == MAP_CTRL_EMPTY) {
         resize(m);
+        i = find_insert_slot(m, hash);
     }
 
-    size_t first_tombstone = m->capacity; // not found
-    size_t i = entry(m, key);
-    for (;; i = (i + 1) & (m->capacity - 1)) {
-        if (key_eq(m, m->entries[i].key, key)) {
-            m->entries[i].ptr = ptr;
-        } else if (m->entries[i].key == TOMBSTONE) {
-            if (first_tombstone == m->capacity) {
-                first_tombstone = i;
-            }
-        } else if (m->entries[i].key == NULL) {
-            // Key isn't in map, fill in first tombstone if we passed one, or
-            // current location.
-            if (first_tombstone != m->capacity) {
-                i = first_tombstone;
-            }
-            m->entries[i] = (struct entry){.key = key, .ptr = ptr};
-            m->count++;
-            return;
-        }
+    if (m->ctrl[i] == MAP_CTRL_EMPTY) {
+        m->growth_left--;
+    }
+    set_ctrl(m, i, map_h2(hash));
+    m->hashes[i] = hash;
+    m->count++;
+
+    return i;
+}
+
+void map_insert(struct map *m, const void *key, void *ptr) {
+    uint32_t hash = m->key->hasher(key);
+
+    size_t i = find(m, key, hash);
+    if (i == NOT_FOUND) {
+        i = prepare_insert(m, hash);
+        m->entries[i].key = key;
+    }
+    m->entries[i].value = ptr;
+}
+
+void **map_get_or_insert(struct map *m, const void *key, bool *inserted) {
+    uint32_t hash = m->key->hasher(key);
+
+    size_t i = find(m, key, hash);
+    *inserted = (i == NOT_FOUND);
+    if (*inserted) {
+        i = prepare_insert(m, hash);
+        m->entries[i] = (struct map_entry){.key = key, .value = NULL};
+    }
+    return &m->entries[i].value;
+}
+
+struct map_entry *map_entry(struct map *m, uint32_t hash,
+                            bool (*eq)(const void *context, const void *key),
+                            const void *context, bool *inserted) {
+    size_t i = find_by(m, hash, eq, context);
+    *inserted = (i == NOT_FOUND);
+    if (*inserted) {
+        i = prepare_insert(m, hash);
+        m->entries[i] = (struct map_entry){.key = NULL, .value = NULL};
     }
+    return &m->entries[i];
 }
 
 void *map_get(struct map *m, const void *key) {
-    size_t i = entry(m, key);
-    for (;; i = (i + 1) & (m->capacity - 1)) {
-        if (key_eq(m, m->entries[i].key, key)) {
-            return m->entries[i].ptr;
-        } else if (m->entries[i].key == NULL) {
-            return NULL;
-        }
+    size_t i = find(m, key, m->key->hasher(key));
+    if (i == NOT_FOUND) {
+        return NULL;
     }
+    return m->entries[i].value;
 }
 
 void map_remove(struct map *m, const void *key) {
-    size_t i = entry(m, key);
-    for (;; i = (i + 1) & (m->capacity - 1)) {
-        if (key_eq(m, m->entries[i].key, key)) {
-            m->entries[i].key = TOMBSTONE;
-            m->count--;
-            return;
-        } else if (m->entries[i].key == NULL) {
-            return;
-        }
+    size_t i = find(m, key, m->key->hasher(key));
+    if (i == NOT_FOUND) {
+        return;
     }
+
+    set_ctrl(m, i, MAP_CTRL_DELETED);
+    m->count--;
+}
+
+size_t map_len(struct map *m) { return m->count; }
+
+struct map_stats map_stats(struct map *m) {
+    return map_stats_of(m->ctrl, m->hashes, m->capacity);
 }
 
 bool map_iter(struct map *m, void *context,
               bool (*callback)(void *context, const void *key, void *value)) {
-    for (struct entry *it = m->entries; it < (m->entries + m->capacity); it++) {
-        if (it->key != NULL && it->key != TOMBSTONE) {
-            if (!callback(context, it->key, it->ptr)) {
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->ctrl[i] >= 0) {
+            if (!callback(context, m->entries[i].key, m->entries[i].value)) {
                 return false;
             }
         }
@@ -9,8 +9,30 @@ struct map_key {
     bool (*eq)(const void *, const void *);
 };
 
+// NUL-terminated string keys and pointer keys. The _fnv variants use the
+// slower byte-at-a-time FNV-1a hash, for comparison.
 extern struct map_key *map_key_string;
+extern struct map_key *map_key_string_fnv;
 extern struct map_key *map_key_pointer;
+extern struct map_key *map_key_pointer_fnv;
+
+// The hash that map_key_string uses, for a string of len bytes that need not be
+// NUL-terminated.
+uint32_t map_hash_string(const char *str, size_t len);
+
+// How well a map's keys are spread across it.
+struct map_stats {
+    size_t count;
+    size_t capacity;
+    // Groups probed to find each key, on average and at worst. 1 is ideal.
+    double mean_probe;
+    size_t max_probe;
+};
+
+struct map_entry {
+    const void *key;
+    void *value;
+};
 
 struct map;
 
@@ -21,6 +43,28 @@ void map_insert(struct map *m, const void *key, void *ptr);
 void *map_get(struct map *m, const void *key);
 void map_remove(struct map *m, const void *key);
 
+// Returns a pointer to the value for key, inserting key with a NULL value if it
+// isn't already in the map, in a single probe. *inserted is set if the key was
+// inserted. The pointer is valid until the map is next modified.
+void **map_get_or_insert(struct map *m, const void *key, bool *inserted);
+
+// Like map_get_or_insert(), but for callers that have already hashed the key,
+// or whose key has a different representation to the stored keys. hash must be
+// the map_key's hash of the stored key, and eq(context, key) must return true
+// for the stored key that is being looked up.
+// If no stored key matches, an entry with a NULL key and value is reserved and
+// *inserted is set. The caller must then set the entry's key (to a key with
+// the given hash) before the map is next used. The entry is valid until the
+// map is next modified.
+struct map_entry *map_entry(struct map *m, uint32_t hash,
+                            bool (*eq)(const void *context, const void *key),
+                            const void *context, bool *inserted);
+
+// Number of entries in the map.
+size_t map_len(struct map *m);
+
+struct map_stats map_stats(struct map *m);
+
 // Iterates over key/value pairs in the map (in arbitrary order). Stops
 // iterating when the provided callback returns false. The callback must not
 // mutate the key, value or any other entry in the map. The provided context
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "map.h"
+
+// Typed hash maps, instantiated for a key and value type with:
+//
+//     MAP_DEFINE(name, K, V, hash, eq)
+//
+// where hash(K) returns a uint32_t and eq(K, K) returns a bool. This defines
+// struct name, with the same layout of table as struct map (see map.c), and
+// static inline functions over it:
+//
+//     V *name_get(struct name *m, K key);
+//     void name_insert(struct name *m, K key, V value);
+//     struct name_entry *name_entry(struct name *m, K key, bool *inserted);
+//     size_t name_len(struct name *m);
+//     struct map_stats name_stats(struct name *m);
+//     void name_free(struct name *m);
+//
+// Unlike struct map, the hash and eq functions are inlined and values are
+// stored unboxed. A zeroed struct name is an empty map, which doesn't
+// allocate until something is inserted. name_free() releases the table, but
+// not the struct itself.
+
+#define MAP_GROUP_SIZE 16
+#define MAP_MIN_CAPACITY 16
+
+#define MAP_CTRL_EMPTY ((int8_t)-128)
+#define MAP_CTRL_DELETED ((int8_t)-2)
+
+#define MAP_NOT_FOUND SIZE_MAX
+
+// Bitmask with bit i set if control byte i of the group matches.
+typedef uint32_t map_group_mask_t;
+
+#if defined(__SSE2__)
+
+static inline map_group_mask_t map_group_match(const int8_t *group,
+                                               int8_t h2) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+}
+
+// EMPTY and DELETED are the only negative control bytes other than -1, which
+// is never used.
+static inline map_group_mask_t
+map_group_match_empty_or_deleted(const int8_t *group) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+}
+
+#else
+
+static inline map_group_mask_t map_group_match(const int8_t *group,
+                                               int8_t h2) {
+    map_group_mask_t mask = 0;
+    for (size_t i = 0; i < MAP_GROUP_SIZE; i++) {
+        mask |= (map_group_mask_t)(group[i] == h2) << i;
+    }
+    return mask;
+}
+
+static inline map_group_mask_t
+map_group_match_empty_or_deleted(const int8_t *group) {
+    map_group_mask_t mask = 0;
+    for (size_t i = 0; i < MAP_GROUP_SIZE; i++) {
+        mask |= (map_group_mask_t)(group[i] < -1) << i;
+    }
+    return mask;
+}
+
+#endif
+
+static inline map_group_mask_t map_group_match_empty(const int8_t *group) {
+    return map_group_match(group, MAP_CTRL_EMPTY);
+}
+
+// High bits of the hash select the starting group, the low 7 bits are stored
+// in the control byte.
+static inline size_t map_h1(uint32_t hash) { return hash >> 7; }
+static inline int8_t map_h2(uint32_t hash) { return hash & 0x7f; }
+
+// We keep at most 7/8 of the slots non-EMPTY, so that probing terminates
+// quickly.
+static inline size_t map_max_load(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+// Quadratic probing over groups. Visits every group exactly once when the
+// number of groups is a power of two.
+struct map_probe {
+    size_t pos;
+    size_t stride;
+    size_t mask;
+};
+
+static inline struct map_probe map_probe_start(size_t capacity,
+                                               uint32_t hash) {
+    return (struct map_probe){
+        .pos = map_h1(hash) & (capacity - 1),
+        .stride = 0,
+        .mask = capacity - 1,
+    };
+}
+
+static inline void map_probe_next(struct map_probe *p) {
+    p->stride += MAP_GROUP_SIZE;
+    p->pos = (p->pos + p->stride) & p->mask;
+}
+
+// Returns the first EMPTY or DELETED slot along the probe sequence for hash.
+static inline size_t map_find_insert_slot(const int8_t *ctrl, size_t capacity,
+                                          uint32_t hash) {
+    for (struct map_probe p = map_probe_start(capacity, hash);;
+         map_probe_next(&p)) {
+        map_group_mask_t match = map_group_match_empty_or_deleted(ctrl + p.pos);
+        if (match) {
+            return (p.pos + __builtin_ctz(match)) & p.mask;
+        }
+    }
+}
+
+// Sets a control byte, and its mirror after the end of the table.
+static inline void map_set_ctrl(int8_t *ctrl, size_t capacity, size_t i,
+                                int8_t value) {
+    ctrl[i] = value;
+    if (i < MAP_GROUP_SIZE) {
+        ctrl[capacity + i] = value;
+    }
+}
+
+static inline int8_t *map_ctrl_new(size_t capacity) {
+    int8_t *ctrl = malloc(capacity + MAP_GROUP_SIZE);
+    memset(ctrl, MAP_CTRL_EMPTY, capacity + MAP_GROUP_SIZE);
+    return ctrl;
+}
+
+// Number of groups probed to find the key in slot i, which has the given
+// hash: 1 if it's in the first group that we look at.
+static inline size_t map_probe_length(size_t capacity, uint32_t hash,
+                                      size_t i) {
+    size_t n = 1;
+    for (struct map_probe p = map_probe_start(capacity, hash);;
+         map_probe_next(&p), n++) {
+        if (((i - p.pos) & p.mask) < MAP_GROUP_SIZE) {
+            return n;
+        }
+    }
+}
+
+static inline struct map_stats map_stats_of(const int8_t *ctrl,
+                                            const uint32_t *hashes,
+                                            size_t capacity) {
+    struct map_stats stats = {.capacity = capacity};
+    size_t total = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        if (ctrl[i] < 0) {
+            continue;
+        }
+        size_t probes = map_probe_length(capacity, hashes[i], i);
+        total += probes;
+        stats.max_probe = probes > stats.max_probe ? probes : stats.max_probe;
+        stats.count++;
+    }
+    stats.mean_probe = stats.count > 0 ? (double)total / stats.count : 0;
+    return stats;
+}
+
+// Hashing:
+//
+// Strings are hashed in the style of wyhash: whole 8-byte words at a time
+// (with overlapping reads for short strings, rather than a byte loop), mixed
+// by folding the 128-bit product of two 64-bit words. Pointers are hashed by
+// multiplying by a large odd constant and keeping the high bits, which are
+// the well-mixed ones.
+//
+// The FNV-1a variants are the hashes that we used to use, kept for
+// comparison.
+
+#define MAP_FNV_OFFSET_BASIS 2166136261u
+#define MAP_FNV_PRIME 16777619u
+
+#define MAP_WY0 0xa0761d6478bd642full
+#define MAP_WY1 0xe7037ed1a0b428dbull
+
+static inline uint64_t map_mum(uint64_t a, uint64_t b) {
+    __extension__ typedef unsigned __int128 u128;
+    u128 r = (u128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t map_read8(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t map_read4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t map_hash_bytes(const char *str, size_t len) {
+    const unsigned char *p = (const unsigned char *)str;
+    uint64_t seed = MAP_WY0;
+    uint64_t a, b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            // Two (possibly overlapping) pairs of 4-byte reads cover every
+            // byte.
+            size_t mid = (len >> 3) << 2;
+            a = (map_read4(p) << 32) | map_read4(p + mid);
+            b = (map_read4(p + len - 4) << 32) | map_read4(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) |
+                p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        for (; i > 16; i -= 16, p += 16) {
+            seed = map_mum(map_read8(p) ^ MAP_WY1, map_read8(p + 8) ^ seed);
+        }
+        // The last 16 bytes, overlapping what we've already mixed in.
+        a = map_read8(p + i - 16);
+        b = map_read8(p + i - 8);
+    }
+
+    uint64_t h = map_mum(MAP_WY1 ^ len, map_mum(a ^ MAP_WY1, b ^ seed));
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static inline uint32_t map_hash_bytes_fnv(const char *str, size_t len) {
+    uint32_t hash = MAP_FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= str[i];
+        hash *= MAP_FNV_PRIME;
+    }
+    return hash;
+}
+
+// Hash and eq for pointer keys.
+static inline uint32_t map_hash_ptr(const void *key) {
+    // NOTE: Casting pointer to integer is implementation defined.
+    uint64_t x = (uintptr_t)key;
+    return (x * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+static inline uint32_t map_hash_ptr_fnv(const void *key) {
+    return map_hash_bytes_fnv((const char *)&key, sizeof(key));
+}
+
+static inline bool map_eq_ptr(const void *a, const void *b) { return a == b; }
+
+#define MAP_DEFINE(NAME, K, V, HASH, EQ)                                       \
+    struct NAME##_entry {                                                      \
+        K key;                                                                 \
+        V value;                                                               \
+    };                                                                         \
+                                                                               \
+    struct NAME {                                                              \
+        int8_t *ctrl;                                                          \
+        struct NAME##_entry *entries;                                          \
+        uint32_t *hashes;                                                      \
+        size_t count;                                                          \
+        size_t growth_left;                                                    \
+        /* A power of two, or 0 before the first insertion. */                 \
+        size_t capacity;                                                       \
+    };                                                                         \
+                                                                               \
+    static inline void NAME##_alloc(struct NAME *m, size_t capacity) {         \
+        m->capacity = capacity;                                                \
+        m->count = 0;                                                          \
+        m->growth_left = map_max_load(capacity);                               \
+        m->entries = malloc(capacity * sizeof(struct NAME##_entry));           \
+        m->hashes = malloc(capacity * sizeof(uint32_t));                       \
+        m->ctrl = map_ctrl_new(capacity);                                      \
+    }                                                                          \
+                                                                               \
+    static inline void NAME##_free(struct NAME *m) {                           \
+        free(m->ctrl);                                                         \
+        free(m->entries);                                                      \
+        free(m->hashes);                                                       \
+        *m = (struct NAME){0};                                                 \
+    }                                                                          \
+                                                                               \
+    static inline size_t NAME##_len(struct NAME *m) { return m->count; }       \
+                                                                               \
+    static inline struct map_stats NAME##_stats(struct NAME *m) {              \
+        return map_stats_of(m->ctrl, m->hashes, m->capacity);                  \
+    }                                                                          \
+                                                                               \
+    static inline size_t NAME##_find(struct NAME *m, K key, uint32_t hash) {   \
+        if (m->capacity == 0) {                                                \
+            return MAP_NOT_FOUND;                                              \
+        }                                                                      \
+        int8_t fragment = map_h2(hash);                                        \
+        for (struct map_probe p = map_probe_start(m->capacity, hash);;         \
+             map_probe_next(&p)) {                                             \
+            const int8_t *group = m->ctrl + p.pos;                             \
+            map_group_mask_t match = map_group_match(group, fragment);         \
+            for (; match; match &= match - 1) {                                \
+                size_t i = (p.pos + __builtin_ctz(match)) & p.mask;            \
+                if (m->hashes[i] == hash && EQ(m->entries[i].key, key)) {      \
+                    return i;                                                  \
+                }                                                              \
+            }                                                                  \
+            if (map_group_match_empty(group)) {                                \
+                return MAP_NOT_FOUND;                                          \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    /* Rebuilds the table with room for at least one more entry. */            \
+    static inline void NAME##_resize(struct NAME *m) {                         \
+        struct NAME old = *m;                                                  \
+        size_t capacity = old.capacity;                                        \
+        if (capacity == 0) {                                                   \
+            capacity = MAP_MIN_CAPACITY;                                       \
+        } else if (old.count + 1 > map_max_load(capacity) / 2) {               \
+            capacity *= 2;                                                     \
+        }                                                                      \
+        NAME##_alloc(m, capacity);                                             \
+                                                                               \
+        for (size_t i = 0; i < old.capacity; i++) {                            \
+            if (old.ctrl[i] < 0) {                                             \
+                continue;                                                      \
+            }                                                                  \
+            uint32_t hash = old.hashes[i];                                     \
+            size_t j = map_find_insert_slot(m->ctrl, capacity, hash);          \
+            map_set_ctrl(m->ctrl, capacity, j, map_h2(hash));                  \
+            m->entries[j] = old.entries[i];                                    \
+            m->hashes[j] = hash;                                               \
+        }                                                                      \
+        m->count = old.count;                                                  \
+        m->growth_left -= old.count;                                           \
+                                                                               \
+        free(old.ctrl);                                                        \
+        free(old.entries);                                                     \
+        free(old.hashes);                                                      \
+    }                                                                          \
+                                                                               \
+    /* Returns the entry for key, inserting it with a zeroed value if it */    \
+    /* isn't already in the map. Valid until the map is next modified. */      \
+    static inline struct NAME##_entry *NAME##_entry(struct NAME *m, K key,     \
+                                                    bool *inserted) {          \
+        uint32_t hash = HASH(key);                                             \
+        size_t i = NAME##_find(m, key, hash);                                  \
+        *inserted = (i == MAP_NOT_FOUND);                                      \
+        if (!*inserted) {                                                      \
+            return &m->entries[i];                                             \
+        }                                                                      \
+                                                                               \
+        if (m->capacity == 0) {                                                \
+            NAME##_resize(m);                                                  \
+        }                                                                      \
+        i = map_find_insert_slot(m->ctrl, m->capacity, hash);                  \
+        /* Reusing a tombstone doesn't use up an EMPTY slot. */                \
+        if (m->growth_left == 0 && m->ctrl[i] == MAP_CTRL_EMPTY) {             \
+            NAME##_resize(m);                                                  \
+            i = map_find_insert_slot(m->ctrl, m->capacity, hash);              \
+        }                                                                      \
+        if (m->ctrl[i] == MAP_CTRL_EMPTY) {                                    \
+            m->growth_left--;                                                  \
+        }                                                                      \
+        map_set_ctrl(m->ctrl, m->capacity, i, map_h2(hash));                   \
+        m->hashes[i] = hash;                                                   \
+        m->count++;                                                            \
+                                                                               \
+        m->entries[i] = (struct NAME##_entry){.key = key};                     \
+        return &m->entries[i];                                                 \
+    }                                                                          \
+                                                                               \
+    static inline void NAME##_insert(struct NAME *m, K key, V value) {         \
+        bool inserted;                                                         \
+        NAME##_entry(m, key, &inserted)->value = value;                        \
+    }                                                                          \
+                                                                               \
+    /* Returns a pointer to the value for key, or NULL. */                     \
+    static inline V *NAME##_get(struct NAME *m, K key) {                       \
+        size_t i = NAME##_find(m, key, HASH(key));                             \
+        return i == MAP_NOT_FOUND ? NULL : &m->entries[i].value;               \
+    }
@@ -1,28 +1,194 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
 #include "ast.h"
 #include "ident.h"
 #include "lexer.h"
 #include "map.h"
 #include "parser.h"
+#include "tokens.h"
 #include "ty.h"
 #include "vec.h"
+#include "vec_define.h"
+
+// Programs with fewer tokens per thread than this are parsed serially.
+#define MIN_TOKENS_PER_THREAD (16 * 1024)
+
+// An infix operator whose left operand has been parsed, waiting on its right
+// operand. See parse_expr().
+struct pending {
+    ast_expr_idx_t lhs;
+    const struct infix *op;
+};
+
+VEC_DEFINE(operator_stack, struct pending)
+
+enum frame_kind {
+    Frame_Block,
+    Frame_Then,
+    Frame_Else,
+};
+
+// A statement which has been opened, but which contains statements that are
+// still being parsed. See parse_block().
+struct frame {
+    // enum frame_kind:
+    uint8_t kind;
+    // Frame_Then, Frame_Else:
+    ast_expr_idx_t cond;
+    // Frame_Else:
+    ast_stmt_idx_t arm1;
+    // Frame_Block, the items so far (struct ast_block_item):
+    struct vec *items;
+};
+
+VEC_DEFINE(frame_stack, struct frame)
 
 typedef struct {
     const char *prog;
     struct ident_table *idents;
-    lexer_state_t lexer;
-    token_t token;
-    bool eof;
+    // All AST nodes are allocated from the program's arena.
+    struct arena *arena;
+    // Nodes of the function currently being parsed. parse_function() moves
+    // them into the arena once the function is complete.
+    struct {
+        struct vec *exprs;  // ast_expr_t
+        struct vec *stmts;  // ast_statement_t
+        struct vec *blocks; // ast_block_t
+        struct vec *consts; // struct ast_const
+        struct vec *idents; // struct ident *
+    } nodes;
+    // The parser walks the pre-lexed tokens by index. pos never goes past
+    // the Token_Eof at the end.
+    struct tokens *tokens;
+    size_t pos;
+
+    // The most operators, or statement frames, that may be open at once.
+    size_t max_depth;
+    // Used in place of the native stack, and reused from one expression or
+    // function to the next.
+    struct operator_stack operators;
+    struct frame_stack frames;
+
+    // Skip function bodies rather than parse them.
+    bool lazy_bodies;
+
+    // Where errors are reported, if the parser is to recover from them.
+    struct diags *diags;
+    // The earliest error in the source, whether or not the parser recovered
+    // from it.
+    parse_result_t error;
 } state_t;
 
+struct parser_lazy {
+    const char *prog;
+    struct ident_table *idents;
+    struct tokens *tokens;
+    size_t max_depth;
+    struct diags *diags;
+};
+
+static void state_free(state_t *state) {
+    operator_stack_free(&state->operators);
+    frame_stack_free(&state->frames);
+}
+
 static parse_result_t ok() { return (parse_result_t){.kind = Parse_Result_Ok}; }
 
+// Kind of the token n tokens ahead of the current one. Looking past the end
+// gives Token_Eof.
+static token_discrim_t peek(state_t *state, size_t n) {
+    size_t i = state->pos + n;
+    size_t len = state->tokens->len;
+    return state->tokens->kinds[i < len ? i : len];
+}
+
+static token_discrim_t kind(state_t *state) { return peek(state, 0); }
+
+static uint32_t payload(state_t *state) {
+    return state->tokens->payloads[state->pos];
+}
+
+static token_span_t span(state_t *state) {
+    return (token_span_t){.offset = state->tokens->offsets[state->pos],
+                          .len = state->tokens->lens[state->pos]};
+}
+
 static parse_result_t error(state_t *state, const char *msg) {
     return (parse_result_t){.kind = Parse_Result_Error,
-                            .diag = {.span = state->token.span, .msg = msg}};
+                            .diag = {.span = span(state), .msg = msg}};
+}
+
+static void *alloc(state_t *state, size_t size) {
+    return arena_alloc(state->arena, size);
+}
+
+// Moves the contents of a vec into the arena, freeing the vec. Returns the
+// number of elements.
+static size_t vec_into_arena(state_t *state, struct vec *v, void **out) {
+    size_t count = vec_len(v);
+    *out = arena_copy(state->arena, v->data, count * v->elem_size);
+    vec_free(v);
+    return count;
+}
+
+static ast_expr_idx_t push_expr(state_t *state, ast_expr_t expr) {
+    return vec_append(state->nodes.exprs, &expr);
+}
+
+static ast_stmt_idx_t push_stmt(state_t *state, ast_statement_t stmt) {
+    return vec_append(state->nodes.stmts, &stmt);
+}
+
+static ast_block_idx_t push_block(state_t *state, ast_block_t block) {
+    return vec_append(state->nodes.blocks, &block);
+}
+
+// Adds the current token's constant to the function's side table.
+static uint32_t push_const(state_t *state) {
+    token_span_t s = span(state);
+    struct ast_const c = {.str = state->prog + s.offset, .len = s.len};
+    return vec_append(state->nodes.consts, &c);
+}
+
+// Adds the current token's identifier to the function's side table.
+static uint32_t push_ident(state_t *state) {
+    struct ident *ident = ident_table_get(state->idents, payload(state));
+    return vec_append(state->nodes.idents, &ident);
+}
+
+static void nodes_begin(state_t *state) {
+    state->nodes.exprs = vec_new(sizeof(ast_expr_t));
+    state->nodes.stmts = vec_new(sizeof(ast_statement_t));
+    state->nodes.blocks = vec_new(sizeof(ast_block_t));
+    state->nodes.consts = vec_new(sizeof(struct ast_const));
+    state->nodes.idents = vec_new(sizeof(struct ident *));
+}
+
+static void nodes_discard(state_t *state) {
+    vec_free(state->nodes.exprs);
+    vec_free(state->nodes.stmts);
+    vec_free(state->nodes.blocks);
+    vec_free(state->nodes.consts);
+    vec_free(state->nodes.idents);
+}
+
+// Moves the nodes of the current function into the arena.
+static void nodes_end(state_t *state, struct ast_nodes *nodes) {
+    nodes->nexprs =
+        vec_into_arena(state, state->nodes.exprs, (void **)&nodes->exprs);
+    nodes->nstmts =
+        vec_into_arena(state, state->nodes.stmts, (void **)&nodes->stmts);
+    nodes->nblocks =
+        vec_into_arena(state, state->nodes.blocks, (void **)&nodes->blocks);
+    nodes->nconsts =
+        vec_into_arena(state, state->nodes.consts, (void **)&nodes->consts);
+    nodes->nidents =
+        vec_into_arena(state, state->nodes.idents, (void **)&nodes->idents);
 }
 
 static bool iserror(parse_result_t result) {
@@ -30,42 +196,94 @@ static bool iserror(parse_result_t result) {
 }
 
 static void advance(state_t *state) {
-    state->eof |= !lexer_next_token(&state->lexer, &state->token);
+    if (state->pos < state->tokens->len) {
+        state->pos++;
+    }
 }
 
-static bool eof(state_t *state) { return state->eof; }
+static bool eof(state_t *state) { return kind(state) == Token_Eof; }
 
 static bool keyword(state_t *state, token_keyword_t keyword) {
-    return state->token.discrim == Token_Keyword &&
-           state->token.keyword == keyword;
+    return kind(state) == Token_Keyword && payload(state) == keyword;
 }
 
 static bool punctuator(state_t *state, token_punctuator_t punctuator) {
-    return state->token.discrim == Token_Punctuator &&
-           state->token.punctuator == punctuator;
+    return kind(state) == Token_Punctuator && payload(state) == punctuator;
 }
 
 static bool identifier(state_t *state, struct ident **ident) {
-    if (state->token.discrim == Token_Identifier) {
-        *ident = state->token.ident;
+    if (kind(state) == Token_Identifier) {
+        *ident = ident_table_get(state->idents, payload(state));
         return true;
     }
     return false;
 }
 
+// Error recovery:
+//
+// With a list of diagnostics to report to, the parser recovers from errors
+// in panic mode. An error within a statement or declaration is reported,
+// and the parser skips past the end of it: to just after a ";", or a
+// balanced "{...}", or to just before the "}" that closes the block it's in.
+// The statement is replaced by a placeholder and parsing carries on. An
+// error outside of a function body skips the rest of the function.
+//
+// Each error skips at least one token, or closes a block, so recovery is
+// linear in the input. Once the list is full, the parser gives up.
+
+// Returns whichever of two results has the earlier error.
+static parse_result_t earliest(parse_result_t a, parse_result_t b) {
+    if (!iserror(a) ||
+        (iserror(b) && b.diag.span.offset < a.diag.span.offset)) {
+        return b;
+    }
+    return a;
+}
+
+// Records an error, and returns whether to carry on past it.
+static bool recover(state_t *state, parse_result_t result) {
+    state->error = earliest(state->error, result);
+    return state->diags != NULL && diags_report(state->diags, result.diag);
+}
+
+// Skips to the end of the statement that an error was in.
+static void synchronize(state_t *state) {
+    size_t depth = 0;
+    while (!eof(state)) {
+        if (punctuator(state, Punctuator_OpenBrace)) {
+            depth++;
+        } else if (punctuator(state, Punctuator_CloseBrace)) {
+            if (depth == 0) {
+                return;
+            }
+            if (--depth == 0) {
+                advance(state);
+                // A block might be the first arm of an if.
+                if (!keyword(state, Keyword_else)) {
+                    return;
+                }
+            }
+        } else if (depth == 0 && punctuator(state, Punctuator_Semicolon)) {
+            advance(state);
+            return;
+        }
+        advance(state);
+    }
+}
+
 // <expr-primary> = <constant>
-parse_result_t parse_expr_primary(state_t *state, ast_expr_t *expr) {
-    if (state->token.discrim == Token_Constant) {
-        *expr = (ast_expr_t){
-            .discrim = Ast_Expr_Constant,
-            .str = state->token.str,
-        };
+parse_result_t parse_expr_primary(state_t *state, ast_expr_idx_t *expr) {
+    if (kind(state) == Token_Constant) {
+        *expr = push_expr(state, (ast_expr_t){
+                                     .discrim = Ast_Expr_Constant,
+                                     .constant = push_const(state),
+                                 });
         advance(state);
-    } else if (state->token.discrim == Token_Identifier) {
-        *expr = (ast_expr_t){
-            .discrim = Ast_Expr_Var,
-            .ident = state->token.ident,
-        };
+    } else if (kind(state) == Token_Identifier) {
+        *expr = push_expr(state, (ast_expr_t){
+                                     .discrim = Ast_Expr_Var,
+                                     .ident = push_ident(state),
+                                 });
         advance(state);
     } else {
         return error(state, "expected primary expression");
@@ -74,70 +292,41 @@ parse_result_t parse_expr_primary(state_t *state, ast_expr_t *expr) {
     return ok();
 }
 
-parse_result_t parse_expr_postfix(state_t *state, ast_expr_t *expr) {
+parse_result_t parse_expr_postfix(state_t *state, ast_expr_idx_t *expr) {
     parse_result_t result = {0};
     if (iserror(result = parse_expr_primary(state, expr))) {
         return result;
     }
 
     while (true) {
-        if (state->token.discrim != Token_Punctuator) {
+        bool deref;
+        if (punctuator(state, Punctuator_Period)) {
+            deref = false;
+        } else if (punctuator(state, Punctuator_Arrow)) {
+            deref = true;
+        } else {
             return ok();
         }
+        advance(state);
 
-        switch (state->token.punctuator) {
-        case Punctuator_Period: {
-            advance(state);
-
-            struct ident *ident;
-            if (!identifier(state, &ident)) {
-                return error(state, "expected identifier");
-            }
-            advance(state);
-
-            ast_expr_t *lhs = malloc(sizeof(ast_expr_t));
-            *lhs = *expr;
-
-            *expr = (ast_expr_t){.discrim = Ast_Expr_MemberOf,
-                                 .member = {
-                                     .deref = false,
-                                     .lhs = lhs,
-                                     .ident = ident,
-                                 }};
-            break;
-        }
-
-        case Punctuator_Arrow: {
-            advance(state);
-
-            struct ident *ident;
-            if (!identifier(state, &ident)) {
-                return error(state, "expected identifier");
-            }
-            advance(state);
-
-            ast_expr_t *lhs = malloc(sizeof(ast_expr_t));
-            *lhs = *expr;
-
-            *expr = (ast_expr_t){.discrim = Ast_Expr_MemberOf,
-                                 .member = {
-                                     .deref = true,
-                                     .lhs = lhs,
-                                     .ident = ident,
-                                 }};
-            break;
+        if (kind(state) != Token_Identifier) {
+            return error(state, "expected identifier");
         }
 
-        default:
-            return ok();
-        }
+        *expr = push_expr(state, (ast_expr_t){
+                                     .discrim = Ast_Expr_MemberOf,
+                                     .deref = deref,
+                                     .lhs = *expr,
+                                     .ident = push_ident(state),
+                                 });
+        advance(state);
     }
 }
 
 // <expr-unary> =   - <expr-primary>
 //                | & <expr-primary>
 //                |   <expr-primary>
-parse_result_t parse_expr_unary(state_t *state, ast_expr_t *expr) {
+parse_result_t parse_expr_unary(state_t *state, ast_expr_idx_t *expr) {
     struct unop {
         token_punctuator_t punctuator;
         ast_unop_t unop;
@@ -165,255 +354,139 @@ parse_result_t parse_expr_unary(state_t *state, ast_expr_t *expr) {
     parse_result_t result;
     // XXX: This should be cast-expression, but at least it should be
     // unary-expression to allow !!
-    if (iserror(result = parse_expr_primary(state, expr))) {
+    ast_expr_idx_t inner;
+    if (iserror(result = parse_expr_primary(state, &inner))) {
         return result;
     }
 
-    ast_expr_t *inner = malloc(sizeof(ast_expr_t));
-    *inner = *expr;
-
-    *expr = (ast_expr_t){
-        .discrim = Ast_Expr_UnOp,
-        .unop = op->unop,
-        .lhs = inner,
-    };
+    *expr = push_expr(state, (ast_expr_t){
+                                 .discrim = Ast_Expr_UnOp,
+                                 .unop = op->unop,
+                                 .lhs = inner,
+                             });
 
     return ok();
 }
 
-struct binop {
-    token_punctuator_t punctuator;
-    ast_binop_t op;
+// Binary and assignment operators are parsed by precedence climbing (a Pratt
+// parser), driven by a table of binding powers indexed by punctuator.
+//
+// Rather than recursing for each right operand, the operators whose right
+// operands are still being parsed are kept on a stack. Each time an operand
+// is parsed, it ends the right operands of the operators on top of the stack
+// which the next operator binds less tightly than: for left-associative
+// operators, those of the same binding power or higher, and for
+// right-associative ones (assignment), those of higher binding power. These
+// are popped and built into nodes, and the next operator is pushed.
+//
+// Punctuators which aren't infix operators have a binding power of 0, which
+// ends the expression.
+
+enum binding_power {
+    Bp_None,
+    Bp_Assignment,
+    Bp_Equality,
+    Bp_Relational,
+    Bp_Additive,
+    Bp_Multiplicative,
 };
 
-parse_result_t parse_expr_binop(state_t *state, ast_expr_t *expr,
-                                struct binop ops[], size_t num_ops,
-                                parse_result_t (*parse_next)(state_t *,
-                                                             ast_expr_t *)) {
-    parse_result_t result;
-    if (iserror(result = parse_next(state, expr))) {
-        return result;
-    }
-
-    while (true) {
-        struct binop *op = NULL;
-        for (size_t i = 0; i < num_ops; i++) {
-            if (punctuator(state, ops[i].punctuator)) {
-                advance(state);
-                op = &ops[i];
-            }
-        }
-
-        if (op == NULL) {
-            return ok();
-        }
-
-        ast_expr_t *lhs = malloc(sizeof(ast_expr_t));
-        *lhs = *expr;
-
-        ast_expr_t *rhs = malloc(sizeof(ast_expr_t));
-        if (iserror(result = parse_next(state, rhs))) {
-            return result;
-        }
+static const struct infix {
+    uint8_t bp;
+    bool assign;
+    // ast_binop_t, or ast_assignop_t if assign.
+    uint8_t op;
+} infix[Punctuator_Count] = {
+    [Punctuator_Assign] = {Bp_Assignment, true, Ast_AssignOp_Assign},
+    [Punctuator_PlusAssign] = {Bp_Assignment, true, Ast_AssignOp_Addition},
+    [Punctuator_MinusAssign] = {Bp_Assignment, true, Ast_AssignOp_Subtraction},
+    [Punctuator_AsteriskAssign] = {Bp_Assignment, true,
+                                   Ast_AssignOp_Multiplication},
+    [Punctuator_ForwardSlashAssign] = {Bp_Assignment, true,
+                                       Ast_AssignOp_Division},
+
+    [Punctuator_Equal] = {Bp_Equality, false, Ast_BinOp_Equal},
+    [Punctuator_NotEqual] = {Bp_Equality, false, Ast_BinOp_NotEqual},
+
+    [Punctuator_LessThan] = {Bp_Relational, false, Ast_BinOp_LessThan},
+    [Punctuator_LessThanEqual] = {Bp_Relational, false,
+                                  Ast_BinOp_LessThanEqual},
+    [Punctuator_GreaterThan] = {Bp_Relational, false, Ast_BinOp_GreaterThan},
+    [Punctuator_GreaterThanEqual] = {Bp_Relational, false,
+                                     Ast_BinOp_GreaterThanEqual},
+
+    [Punctuator_Plus] = {Bp_Additive, false, Ast_BinOp_Addition},
+    [Punctuator_Minus] = {Bp_Additive, false, Ast_BinOp_Subtraction},
+
+    [Punctuator_Asterisk] = {Bp_Multiplicative, false,
+                             Ast_BinOp_Multiplication},
+    [Punctuator_ForwardSlash] = {Bp_Multiplicative, false, Ast_BinOp_Division},
+};
 
-        *expr = (ast_expr_t){
-            .discrim = Ast_Expr_BinOp,
-            .binop = op->op,
-            .lhs = lhs,
-            .rhs = rhs,
-        };
+// The infix operator at the current token, or NULL.
+static const struct infix *peek_infix(state_t *state) {
+    if (kind(state) != Token_Punctuator) {
+        return NULL;
     }
-
-    return ok();
+    const struct infix *op = &infix[payload(state)];
+    return op->bp == Bp_None ? NULL : op;
 }
 
-// <expr-multiplicative> =   <expr-unary>
-//                         | <expr-unary> { + <expr-unary> }
-parse_result_t parse_expr_multiplicative(state_t *state, ast_expr_t *expr) {
-    struct binop ops[] = {
-        {Punctuator_Asterisk, Ast_BinOp_Multiplication},
-        {Punctuator_ForwardSlash, Ast_BinOp_Division},
-    };
-    return parse_expr_binop(state, expr, ops, sizeof(ops) / sizeof(ops[0]),
-                            parse_expr_unary);
+// The lowest binding power an operator must have to be part of op's right
+// operand.
+static enum binding_power rhs_bp(const struct infix *op) {
+    return op->assign ? op->bp : op->bp + 1;
 }
 
-// <expr-additive> =   <expr-multiplicative>
-//                   | <expr-multiplicative> { + <expr-multiplicative> }
-parse_result_t parse_expr_additive(state_t *state, ast_expr_t *expr) {
-    struct binop ops[] = {
-        {Punctuator_Plus, Ast_BinOp_Addition},
-        {Punctuator_Minus, Ast_BinOp_Subtraction},
-    };
-    return parse_expr_binop(state, expr, ops, sizeof(ops) / sizeof(ops[0]),
-                            parse_expr_multiplicative);
-}
-
-parse_result_t parse_expr_relational(state_t *state, ast_expr_t *expr) {
-    struct binop ops[] = {
-        {Punctuator_LessThan, Ast_BinOp_LessThan},
-        {Punctuator_LessThanEqual, Ast_BinOp_LessThanEqual},
-        {Punctuator_GreaterThan, Ast_BinOp_GreaterThan},
-        {Punctuator_GreaterThanEqual, Ast_BinOp_GreaterThanEqual},
-    };
-    return parse_expr_binop(state, expr, ops, sizeof(ops) / sizeof(ops[0]),
-                            parse_expr_additive);
-}
-
-parse_result_t parse_expr_equality(state_t *state, ast_expr_t *expr) {
-    struct binop ops[] = {
-        {Punctuator_Equal, Ast_BinOp_Equal},
-        {Punctuator_NotEqual, Ast_BinOp_NotEqual},
-    };
-    return parse_expr_binop(state, expr, ops, sizeof(ops) / sizeof(ops[0]),
-                            parse_expr_relational);
+static ast_expr_idx_t push_infix(state_t *state, struct pending pending,
+                                 ast_expr_idx_t rhs) {
+    ast_expr_t node = {.lhs = pending.lhs, .rhs = rhs};
+    if (pending.op->assign) {
+        node.discrim = Ast_Expr_AssignOp;
+        node.assignop = pending.op->op;
+    } else {
+        node.discrim = Ast_Expr_BinOp;
+        node.binop = pending.op->op;
+    }
+    return push_expr(state, node);
 }
 
-parse_result_t parse_expr_assignment(state_t *state, ast_expr_t *expr) {
-    struct assignop {
-        token_punctuator_t punctuator;
-        ast_assignop_t assignop;
-    } ops[] = {
-        {Punctuator_Assign, Ast_AssignOp_Assign},
-        {Punctuator_PlusAssign, Ast_AssignOp_Addition},
-        {Punctuator_MinusAssign, Ast_AssignOp_Subtraction},
-        {Punctuator_AsteriskAssign, Ast_AssignOp_Multiplication},
-        {Punctuator_ForwardSlashAssign, Ast_AssignOp_Division},
-    };
-
+parse_result_t parse_expr(state_t *state, ast_expr_idx_t *expr) {
+    struct operator_stack *stack = &state->operators;
     parse_result_t result;
-    if (iserror(result = parse_expr_equality(state, expr))) {
-        return result;
-    }
 
     while (true) {
-        struct assignop *op = NULL;
-        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
-            if (punctuator(state, ops[i].punctuator)) {
-                advance(state);
-                op = &ops[i];
-            }
-        }
-
-        if (op == NULL) {
-            return ok();
-        }
-
-        ast_expr_t *lhs = malloc(sizeof(ast_expr_t));
-        *lhs = *expr;
-
-        ast_expr_t *rhs = malloc(sizeof(ast_expr_t));
-        if (iserror(result = parse_expr_equality(state, rhs))) {
-            return result;
-        }
-
-        *expr = (ast_expr_t){
-            .discrim = Ast_Expr_AssignOp,
-            .assignop = op->assignop,
-            .lhs = lhs,
-            .rhs = rhs,
-        };
-    }
-
-    return ok();
-}
-
-parse_result_t parse_expr(state_t *state, ast_expr_t *expr) {
-    return parse_expr_assignment(state, expr);
-}
-
-parse_result_t parse_block(state_t *state, ast_block_t *block);
-
-// <statement> ::= "return" <expr> ";"
-parse_result_t parse_statement(state_t *state, ast_statement_t *statement) {
-    if (keyword(state, Keyword_return)) {
-        advance(state);
-
-        ast_expr_t *expr = (ast_expr_t *)malloc(sizeof(ast_expr_t));
-        parse_result_t result;
-        if (iserror(result = parse_expr(state, expr))) {
-            return result;
-        }
-
-        *statement = (ast_statement_t){
-            .kind = Ast_Statement_Return,
-            .expr = expr,
-        };
-
-        if (!punctuator(state, Punctuator_Semicolon)) {
-            return error(state, "expected semicolon");
-        }
-        advance(state);
-    } else if (keyword(state, Keyword_if)) {
-        advance(state);
-
-        if (!punctuator(state, Punctuator_OpenParen)) {
-            return error(state, "expected opening parenthesis");
-        }
-        advance(state);
-
-        ast_expr_t *expr = malloc(sizeof(ast_expr_t));
-        parse_result_t result = {0};
-        if (iserror(result = parse_expr(state, expr))) {
-            return result;
-        }
-
-        if (!punctuator(state, Punctuator_CloseParen)) {
-            return error(state, "expected closing parenthesis");
-        }
-        advance(state);
-
-        ast_statement_t *stmt1 = malloc(sizeof(ast_statement_t));
-        if (iserror(result = parse_statement(state, stmt1))) {
-            return result;
+        ast_expr_idx_t operand;
+        if (iserror(result = parse_expr_unary(state, &operand))) {
+            break;
         }
 
-        ast_statement_t *stmt2 = NULL;
-        if (keyword(state, Keyword_else)) {
-            advance(state);
-
-            stmt2 = malloc(sizeof(ast_statement_t));
-            if (iserror(result = parse_statement(state, stmt2))) {
-                return result;
+        const struct infix *op = peek_infix(state);
+        while (operator_stack_len(stack) > 0) {
+            struct pending *top =
+                operator_stack_get(stack, operator_stack_len(stack) - 1);
+            if (op != NULL && op->bp >= rhs_bp(top->op)) {
+                break;
             }
+            operand = push_infix(state, operator_stack_pop(stack), operand);
         }
 
-        *statement = (ast_statement_t){
-            .kind = Ast_Statement_If,
-            .expr = expr,
-            .arm1 = stmt1,
-            .arm2 = stmt2,
-        };
-    } else if (punctuator(state, Punctuator_OpenBrace)) {
-        ast_block_t *block = malloc(sizeof(ast_block_t));
-        parse_result_t result = {0};
-        if (iserror(result = parse_block(state, block))) {
-            return result;
-        }
-
-        *statement = (ast_statement_t){
-            .kind = Ast_Statement_Block,
-            .block = block,
-        };
-    } else {
-        ast_expr_t *expr = malloc(sizeof(ast_expr_t));
-        parse_result_t result = {0};
-        if (iserror(result = parse_expr(state, expr))) {
-            return result;
+        if (op == NULL) {
+            *expr = operand;
+            return ok();
         }
 
-        if (!punctuator(state, Punctuator_Semicolon)) {
-            return error(state, "expected semicolon");
+        if (operator_stack_len(stack) >= state->max_depth) {
+            result = error(state, "expression nested too deeply");
+            break;
         }
+        operator_stack_push(stack, (struct pending){.lhs = operand, .op = op});
         advance(state);
-
-        *statement = (ast_statement_t){
-            .kind = Ast_Statement_Expr,
-            .expr = expr,
-        };
     }
 
-    return ok();
+    // Leave the stack empty for the next expression.
+    stack->len = 0;
+    return result;
 }
 
 parse_result_t parse_type(state_t *state, struct ast_type *type);
@@ -440,7 +513,8 @@ parse_result_t parse_declarator(state_t *state, struct ast_declarator *decl) {
 
     decl->kind = Ast_Declarator_Ident;
     decl->ident = ident;
-    decl->npointers = vec_into_raw(pointers, (void **)&decl->pointers);
+    decl->npointers =
+        vec_into_arena(state, pointers, (void **)&decl->pointers);
     decl->ty = NULL;
 
     return ok();
@@ -475,7 +549,8 @@ parse_result_t parse_struct_declaration(state_t *state,
     }
     advance(state);
 
-    decl->ndeclarators = vec_into_raw(declarators, (void **)&decl->declarators);
+    decl->ndeclarators =
+        vec_into_arena(state, declarators, (void **)&decl->declarators);
 
     return ok();
 }
@@ -516,7 +591,7 @@ parse_result_t parse_type_struct_union(state_t *state, struct ast_type *type) {
 
     type->ident = ident;
     type->ndeclarations =
-        vec_into_raw(declarations, (void **)&type->declarations);
+        vec_into_arena(state, declarations, (void **)&type->declarations);
 
     return ok();
 }
@@ -556,7 +631,7 @@ parse_result_t parse_declaration(state_t *state, struct ast_declaration *decl) {
     }
 
     struct vec *declarators = vec_new(sizeof(struct ast_declarator));
-    struct vec *exprs = vec_new(sizeof(ast_expr_t *));
+    struct vec *exprs = vec_new(sizeof(ast_expr_idx_t));
 
     while (!punctuator(state, Punctuator_Semicolon)) {
         struct ast_declarator declarator = {0};
@@ -564,12 +639,11 @@ parse_result_t parse_declaration(state_t *state, struct ast_declaration *decl) {
             return result;
         }
 
-        ast_expr_t *expr = NULL;
+        ast_expr_idx_t expr = AST_NONE;
         if (punctuator(state, Punctuator_Assign)) {
             advance(state);
 
-            expr = malloc(sizeof(ast_expr_t));
-            if (iserror(result = parse_expr(state, expr))) {
+            if (iserror(result = parse_expr(state, &expr))) {
                 return result;
             }
         }
@@ -583,61 +657,276 @@ parse_result_t parse_declaration(state_t *state, struct ast_declaration *decl) {
     }
     advance(state);
 
-    decl->ndeclarators = vec_into_raw(declarators, (void **)&decl->declarators);
-    vec_into_raw(exprs, (void **)&decl->exprs);
+    decl->ndeclarators =
+        vec_into_arena(state, declarators, (void **)&decl->declarators);
+    vec_into_arena(state, exprs, (void **)&decl->exprs);
 
     return ok();
 }
 
-parse_result_t parse_block_item(state_t *state, struct ast_block_item *item){
-    parse_result_t result = {0};
+static bool starts_declaration(state_t *state) {
+    return keyword(state, Keyword_char) || keyword(state, Keyword_short) ||
+           keyword(state, Keyword_int) || keyword(state, Keyword_long) ||
+           keyword(state, Keyword_struct) || keyword(state, Keyword_union);
+}
 
-    bool is_type =
-        keyword(state, Keyword_char) || keyword(state, Keyword_short) ||
-        keyword(state, Keyword_int) || keyword(state, Keyword_long) ||
-        keyword(state, Keyword_struct) || keyword(state, Keyword_union);
-    if (is_type) {
-        item->kind = Ast_BlockItem_Declaration;
-        if (iserror(result = parse_declaration(state, &item->decl))) {
-            return result;
-        }
-        return ok();
+// <statement> ::= "return" <expr> ";"
+//               | <expr> ";"
+//
+// The statements which can't contain other statements.
+static parse_result_t parse_simple_statement(state_t *state,
+                                             ast_stmt_idx_t *statement) {
+    enum ast_statement_kind kind = Ast_Statement_Expr;
+    if (keyword(state, Keyword_return)) {
+        advance(state);
+        kind = Ast_Statement_Return;
     }
 
-    item->kind = Ast_BlockItem_Statement;
-    if (iserror(result = parse_statement(state, &item->stmt))) {
+    ast_expr_idx_t expr;
+    parse_result_t result;
+    if (iserror(result = parse_expr(state, &expr))) {
         return result;
     }
 
+    if (!punctuator(state, Punctuator_Semicolon)) {
+        return error(state, "expected semicolon");
+    }
+    advance(state);
+
+    *statement = push_stmt(state, (ast_statement_t){
+                                      .kind = kind,
+                                      .expr = expr,
+                                  });
+
     return ok();
 }
 
-// <block> ::= { <statement> }
+// "if" "(" <expr> ")", up to the first arm.
+static parse_result_t parse_if_head(state_t *state, ast_expr_idx_t *cond) {
+    advance(state);
+
+    if (!punctuator(state, Punctuator_OpenParen)) {
+        return error(state, "expected opening parenthesis");
+    }
+    advance(state);
+
+    parse_result_t result;
+    if (iserror(result = parse_expr(state, cond))) {
+        return result;
+    }
+
+    if (!punctuator(state, Punctuator_CloseParen)) {
+        return error(state, "expected closing parenthesis");
+    }
+    advance(state);
+
+    return ok();
+}
+
+static parse_result_t push_frame(state_t *state, struct frame frame) {
+    if (frame_stack_len(&state->frames) >= state->max_depth) {
+        return error(state, "statement nested too deeply");
+    }
+    frame_stack_push(&state->frames, frame);
+    return ok();
+}
+
+static struct frame *top_frame(state_t *state) {
+    return frame_stack_get(&state->frames, frame_stack_len(&state->frames) - 1);
+}
+
+// Parses the statements of the block until its closing brace. Its frame is
+// at the bottom of the stack.
+static parse_result_t parse_frames(state_t *state, ast_block_t *block) {
+    parse_result_t result;
+    // A statement which has just been completed, to be added to the frame
+    // which contains it.
+    ast_stmt_idx_t stmt = AST_NONE;
+
+    while (true) {
+        struct frame *frame = top_frame(state);
+
+        if (stmt != AST_NONE) {
+            if (frame->kind == Frame_Block) {
+                struct ast_block_item item = {
+                    .kind = Ast_BlockItem_Statement,
+                    .stmt = stmt,
+                };
+                vec_append(frame->items, &item);
+                stmt = AST_NONE;
+            } else if (frame->kind == Frame_Then &&
+                       keyword(state, Keyword_else)) {
+                advance(state);
+                frame->kind = Frame_Else;
+                frame->arm1 = stmt;
+                stmt = AST_NONE;
+            } else {
+                bool has_else = frame->kind == Frame_Else;
+                stmt = push_stmt(state, (ast_statement_t){
+                                            .kind = Ast_Statement_If,
+                                            .expr = frame->cond,
+                                            .arm1 = has_else ? frame->arm1
+                                                             : stmt,
+                                            .arm2 = has_else ? stmt : AST_NONE,
+                                        });
+                frame_stack_pop(&state->frames);
+                continue;
+            }
+        }
+
+        // The frame is now waiting on a statement: an arm of an if, or the
+        // next item of a block.
+        if (frame->kind == Frame_Block) {
+            if (punctuator(state, Punctuator_CloseBrace)) {
+                advance(state);
+
+                ast_block_t inner;
+                inner.nitems =
+                    vec_into_arena(state, frame->items, (void **)&inner.items);
+                frame_stack_pop(&state->frames);
+
+                if (frame_stack_len(&state->frames) == 0) {
+                    *block = inner;
+                    return ok();
+                }
+                stmt = push_stmt(state, (ast_statement_t){
+                                            .kind = Ast_Statement_Block,
+                                            .block = push_block(state, inner),
+                                        });
+                continue;
+            }
+
+            if (starts_declaration(state)) {
+                struct ast_block_item item = {
+                    .kind = Ast_BlockItem_Declaration,
+                };
+                if (iserror(result = parse_declaration(state, &item.decl))) {
+                    if (!recover(state, result)) {
+                        return result;
+                    }
+                    synchronize(state);
+                    continue;
+                }
+                vec_append(frame->items, &item);
+                continue;
+            }
+        }
+
+        if (eof(state)) {
+            // Nothing left to recover with.
+            return error(state, "expected closing brace");
+        }
+
+        if (keyword(state, Keyword_if)) {
+            ast_expr_idx_t cond;
+            if (!iserror(result = parse_if_head(state, &cond))) {
+                struct frame then = {.kind = Frame_Then, .cond = cond};
+                result = push_frame(state, then);
+            }
+        } else if (punctuator(state, Punctuator_OpenBrace)) {
+            struct frame inner = {
+                .kind = Frame_Block,
+                .items = vec_new(sizeof(struct ast_block_item)),
+            };
+            if (iserror(result = push_frame(state, inner))) {
+                vec_free(inner.items);
+            } else {
+                advance(state);
+            }
+        } else {
+            result = parse_simple_statement(state, &stmt);
+        }
+
+        if (iserror(result)) {
+            if (!recover(state, result)) {
+                return result;
+            }
+            synchronize(state);
+            stmt = push_stmt(state, (ast_statement_t){
+                                        .kind = Ast_Statement_Expr,
+                                        .expr = AST_NONE,
+                                    });
+        }
+    }
+}
+
+// <block> ::= "{" { <declaration> | <statement> } "}"
+//
+// Blocks and the arms of if statements nest. Rather than recursing for each
+// level, the statements which are still open are kept on a stack of frames,
+// so that deeply nested input can't overflow the native stack.
 parse_result_t parse_block(state_t *state, ast_block_t *block) {
     if (!punctuator(state, Punctuator_OpenBrace)) {
         return error(state, "expected opening brace");
     }
-    advance(state);
 
-    struct vec *items = vec_new(sizeof(struct ast_block_item));
+    struct frame outer = {
+        .kind = Frame_Block,
+        .items = vec_new(sizeof(struct ast_block_item)),
+    };
+    parse_result_t result;
+    if (iserror(result = push_frame(state, outer))) {
+        vec_free(outer.items);
+        return result;
+    }
+    advance(state);
 
-    while (!punctuator(state, Punctuator_CloseBrace)) {
-        struct ast_block_item item = {0};
-        parse_result_t result = {0};
-        if (iserror(result = parse_block_item(state, &item))) {
-            return result;
+    if (iserror(result = parse_frames(state, block))) {
+        while (frame_stack_len(&state->frames) > 0) {
+            struct frame frame = frame_stack_pop(&state->frames);
+            if (frame.kind == Frame_Block) {
+                vec_free(frame.items);
+            }
         }
-        vec_append(items, &item);
     }
-    advance(state);
+    return result;
+}
 
-    block->nitems = vec_into_raw(items, (void **)&block->items);
+static parse_result_t parse_body(state_t *state, ast_function_t *function) {
+    nodes_begin(state);
+
+    parse_result_t result;
+    if (iserror(result = parse_block(state, &function->block))) {
+        nodes_discard(state);
+        return result;
+    }
+
+    nodes_end(state, &function->nodes);
+    function->body = Ast_Body_Parsed;
+    function->body_end = state->pos;
 
     return ok();
 }
 
+// Moves past the body by matching braces, without parsing it. Braces are
+// always tokens of their own, so this only needs to look at token kinds.
+static parse_result_t skip_body(state_t *state, ast_function_t *function) {
+    const uint8_t *kinds = state->tokens->kinds;
+    const uint32_t *payloads = state->tokens->payloads;
+
+    size_t depth = 0;
+    for (size_t i = state->pos; i < state->tokens->len; i++) {
+        if (kinds[i] != Token_Punctuator) {
+            continue;
+        }
+        if (payloads[i] == Punctuator_OpenBrace) {
+            depth++;
+        } else if (payloads[i] == Punctuator_CloseBrace && --depth == 0) {
+            state->pos = i + 1;
+            function->body_end = state->pos;
+            return ok();
+        }
+    }
+
+    state->pos = state->tokens->len;
+    return error(state, "expected closing brace");
+}
+
 // <function> ::= "int" <id> "(" ")" "{" <block> "}"
 parse_result_t parse_function(state_t *state, ast_function_t *function) {
+    const uint32_t *offsets = state->tokens->offsets;
+    uint32_t begin = offsets[state->pos];
+
     if (!keyword(state, Keyword_int)) {
         return error(state, "expected keyword int");
     }
@@ -645,7 +934,6 @@ parse_result_t parse_function(state_t *state, ast_function_t *function) {
 
     struct ident *ident;
     if (!identifier(state, &ident)) {
-        printf("error: expected identifier\n");
         return error(state, "expected identifier");
     }
     advance(state);
@@ -659,54 +947,499 @@ parse_result_t parse_function(state_t *state, ast_function_t *function) {
     }
     advance(state);
 
-    ast_block_t block = {0};
-    parse_result_t result = {0};
-    if (iserror(result = parse_block(state, &block))) {
-        return result;
+    if (!punctuator(state, Punctuator_OpenBrace)) {
+        return error(state, "expected opening brace");
     }
+    *function = (ast_function_t){
+        .ident = ident,
+        .body_begin = state->pos,
+        .begin = begin,
+    };
 
-    *function = (ast_function_t){.ident = ident, .block = block};
+    parse_result_t result = state->lazy_bodies ? skip_body(state, function)
+                                               : parse_body(state, function);
+    if (iserror(result)) {
+        return result;
+    }
 
+    size_t last = state->pos - 1;
+    function->end = offsets[last] + state->tokens->lens[last];
     return ok();
 }
 
 // <program> ::= <function>
 parse_result_t parse_program(state_t *state, ast_program_t *program) {
     struct map *functions = map_new(map_key_string);
+    struct vec *ordered = vec_new(sizeof(ast_function_t *));
 
     while (!eof(state)) {
-        ast_function_t *function = calloc(1, sizeof(ast_function_t));
+        ast_function_t *function = alloc(state, sizeof(ast_function_t));
         parse_result_t result;
         if (iserror(result = parse_function(state, function))) {
-            return result;
+            if (!recover(state, result)) {
+                map_free(functions);
+                vec_free(ordered);
+                return result;
+            }
+
+            // Skip the rest of the function, moving on by at least a token.
+            size_t pos = state->pos;
+            synchronize(state);
+            if (state->pos == pos) {
+                advance(state);
+            }
+            continue;
         }
 
         // TODO: Avoid ident_to_str if/when map can have arbitrary keys
         map_insert(functions, ident_to_str(function->ident), function);
+        vec_append(ordered, &function);
     }
 
-    *program = (ast_program_t){.functions = functions};
-
-    // TODO: free functions
+    *program = (ast_program_t){.functions = functions, .arena = state->arena};
+    program->nfunctions =
+        vec_into_arena(state, ordered, (void **)&program->ordered);
+
+    if (state->lazy_bodies) {
+        program->lazy = alloc(state, sizeof(struct parser_lazy));
+        *program->lazy = (struct parser_lazy){
+            .prog = state->prog,
+            .idents = state->idents,
+            .tokens = state->tokens,
+            .max_depth = state->max_depth,
+            .diags = state->diags,
+        };
+    }
 
     return ok();
 }
 
-parse_result_t parser_parse(struct ident_table *idents, const char *prog,
-                            ast_program_t *program) {
-    lexer_state_t lexer = lexer_new(idents, prog);
-    token_t token;
-    if (!lexer_next_token(&lexer, &token)) {
-        printf("fatal: couldn't lex\n");
-        exit(-1);
+// Parsing bodies in parallel:
+//
+// The functions are first found serially, skipping their bodies by matching
+// braces, which also fills in prog->functions in source order. Then a pool
+// of threads takes the bodies in order, from a shared counter, and parses
+// them. Each thread allocates into its own arena, which is handed to the
+// program once they're all done.
+//
+// Each thread reports errors to its own list, and the lists are merged in
+// order of position afterwards. A thread stops when it can't recover from
+// an error, and the others then stop taking bodies. Every body before the
+// one it stopped in has already been taken, so the first error, and the
+// first errors up to the limit, are the same as they'd be serially.
+
+struct pool {
+    ast_program_t *program;
+    _Atomic size_t next;
+    atomic_bool stopped;
+};
+
+struct worker {
+    struct pool *pool;
+    struct arena *arena;
+    // Used if the program's parser recovers from errors.
+    struct diags diags;
+    // The first body which had an error, or SIZE_MAX, and the error.
+    size_t failed_at;
+    parse_result_t error;
+};
+
+static void *parse_bodies_worker(void *data) {
+    struct worker *worker = data;
+    struct pool *pool = worker->pool;
+    struct parser_lazy *lazy = pool->program->lazy;
+
+    state_t state = {
+        .prog = lazy->prog,
+        .idents = lazy->idents,
+        .arena = worker->arena,
+        .tokens = lazy->tokens,
+        .max_depth = lazy->max_depth,
+        .diags = lazy->diags != NULL ? &worker->diags : NULL,
+    };
+
+    while (!atomic_load(&pool->stopped)) {
+        size_t i = atomic_fetch_add(&pool->next, 1);
+        if (i >= pool->program->nfunctions) {
+            break;
+        }
+
+        ast_function_t *function = pool->program->ordered[i];
+        state.pos = function->body_begin;
+        parse_result_t result = parse_body(&state, function);
+        bool stop = iserror(result) && !recover(&state, result);
+
+        if (worker->failed_at == SIZE_MAX && iserror(state.error)) {
+            worker->failed_at = i;
+        }
+        if (stop) {
+            atomic_store(&pool->stopped, true);
+            break;
+        }
     }
 
+    worker->error = state.error;
+    state_free(&state);
+    return NULL;
+}
+
+static parse_result_t parse_bodies_parallel(ast_program_t *program,
+                                            size_t nthreads) {
+    struct pool pool = {.program = program};
+    struct worker *workers = calloc(nthreads, sizeof(struct worker));
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+
+    struct diags *diags = program->lazy->diags;
+    for (size_t i = 0; i < nthreads; i++) {
+        workers[i] = (struct worker){
+            .pool = &pool,
+            .arena = arena_new(),
+            .diags = {.max = diags != NULL ? diags->max : 0},
+            .failed_at = SIZE_MAX,
+        };
+        pthread_create(&threads[i], NULL, parse_bodies_worker, &workers[i]);
+    }
+
+    parse_result_t result = ok();
+    size_t failed_at = SIZE_MAX;
+    for (size_t i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        arena_absorb(program->arena, workers[i].arena);
+        if (workers[i].failed_at < failed_at) {
+            failed_at = workers[i].failed_at;
+            result = workers[i].error;
+        }
+
+        if (diags != NULL) {
+            for (size_t j = 0; j < workers[i].diags.len; j++) {
+                diags_report(diags, workers[i].diags.list[j]);
+            }
+            diags->truncated |= workers[i].diags.truncated;
+        }
+        diags_free(&workers[i].diags);
+    }
+
+    free(workers);
+    free(threads);
+    return result;
+}
+
+parse_result_t parser_parse_tokens(struct ident_table *idents,
+                                   const char *prog, struct tokens *tokens,
+                                   const struct parser_options *opts,
+                                   ast_program_t *program) {
     state_t state = {
         .prog = prog,
         .idents = idents,
-        .lexer = lexer,
-        .token = token,
-        .eof = false,
+        .arena = arena_new(),
+        .tokens = tokens,
+        .pos = 0,
+        .max_depth = opts != NULL && opts->max_depth != 0 ? opts->max_depth
+                                                          : PARSER_MAX_DEPTH,
+        .lazy_bodies = opts != NULL && opts->lazy_bodies,
+        .diags = opts != NULL ? opts->diags : NULL,
+    };
+
+    // Characters that the lexer skipped. The parser never sees them, so
+    // can carry on regardless, if it's to recover from errors.
+    for (size_t i = 0; i < tokens->diags.len; i++) {
+        parse_result_t result = {.kind = Parse_Result_Error,
+                                 .diag = tokens->diags.list[i]};
+        if (!recover(&state, result)) {
+            arena_free(state.arena);
+            return state.error;
+        }
+    }
+    if (state.diags != NULL) {
+        state.diags->truncated |= tokens->diags.truncated;
+    }
+
+    size_t nthreads = opts != NULL ? opts->jobs : 1;
+    if (nthreads > tokens->len / MIN_TOKENS_PER_THREAD) {
+        nthreads = tokens->len / MIN_TOKENS_PER_THREAD;
+    }
+    // The bodies are skipped at first either way.
+    bool parallel = !state.lazy_bodies && nthreads > 1;
+    state.lazy_bodies |= parallel;
+
+    parse_result_t result = parse_program(&state, program);
+    state_free(&state);
+    if (iserror(result)) {
+        arena_free(state.arena);
+        return earliest(state.error, result);
+    }
+
+    if (parallel) {
+        if (nthreads > program->nfunctions) {
+            nthreads = program->nfunctions;
+        }
+        result = parse_bodies_parallel(program, nthreads);
+        // Every body has been parsed, and the tokens needn't outlive this.
+        program->lazy = NULL;
+    }
+
+    // Errors outside of the bodies, or which the parser recovered from.
+    result = earliest(state.error, result);
+    if (iserror(result)) {
+        ast_program_free(program);
+    }
+    return result;
+}
+
+parse_result_t parser_parse_body(ast_program_t *program,
+                                 ast_function_t *function) {
+    switch (function->body) {
+    case Ast_Body_Unparsed:
+        break;
+    case Ast_Body_Parsed:
+        return ok();
+    case Ast_Body_Failed:
+        return (parse_result_t){.kind = Parse_Result_Error,
+                                .diag = function->error};
+    }
+
+    struct parser_lazy *lazy = program->lazy;
+    state_t state = {
+        .prog = lazy->prog,
+        .idents = lazy->idents,
+        .arena = program->arena,
+        .tokens = lazy->tokens,
+        .pos = function->body_begin,
+        .max_depth = lazy->max_depth,
+        .diags = lazy->diags,
     };
-    return parse_program(&state, program);
+
+    parse_result_t result = parse_body(&state, function);
+    if (iserror(result)) {
+        recover(&state, result);
+    }
+    state_free(&state);
+
+    // Errors which were recovered from leave the body parsed, but it's still
+    // in error.
+    if (iserror(state.error)) {
+        function->body = Ast_Body_Failed;
+        function->error = state.error.diag;
+    }
+    return state.error;
+}
+
+parse_result_t parser_parse_bodies(ast_program_t *program) {
+    struct diags *diags = program->lazy->diags;
+    parse_result_t first = ok();
+
+    for (size_t i = 0; i < program->nfunctions; i++) {
+        parse_result_t result =
+            parser_parse_body(program, program->ordered[i]);
+        if (iserror(result) && !iserror(first)) {
+            first = result;
+        }
+        if (iserror(first) && (diags == NULL || diags->truncated)) {
+            break;
+        }
+    }
+    return first;
+}
+
+parse_result_t parser_parse(struct ident_table *idents, const char *prog,
+                            size_t len, ast_program_t *program) {
+    struct tokens *tokens = tokens_lex(idents, prog, len);
+
+    parse_result_t result =
+        parser_parse_tokens(idents, prog, tokens, NULL, program);
+
+    tokens_free(tokens);
+    return result;
+}
+
+// Reparsing:
+//
+// The lexer has no state between tokens, and each function is parsed
+// without reference to the others. So if an edit falls within one function,
+// and what's left there still lexes cleanly and parses as exactly one
+// function, ending in its closing brace, then parsing the edited source
+// from scratch would give the same functions as before, with that one
+// replaced. Only the function's own text needs lexing and parsing again.
+//
+// Anything else, including an edit which introduces an error, is parsed
+// again in full, so that the result is exactly what parsing from scratch
+// would give.
+//
+// An edit moves every function after it. Rather than move them all each
+// time, the program remembers where the functions that haven't been moved
+// yet begin, and by how much. Each edit only moves those between it and
+// there, which are few as long as the edits are near each other.
+
+// Moves functions [from, to) by delta bytes. Unsigned arithmetic wraps, so
+// this moves them back if delta is "negative".
+static void shift_functions(ast_program_t *program, size_t from, size_t to,
+                            uint32_t delta) {
+    for (size_t j = from; j < to; j++) {
+        program->ordered[j]->begin += delta;
+        program->ordered[j]->end += delta;
+    }
+}
+
+static uint32_t function_begin(ast_program_t *program, size_t i) {
+    uint32_t begin = program->ordered[i]->begin;
+    return i >= program->shifted ? begin + program->shift : begin;
+}
+
+// Returns the index of the function whose extent contains the edit, or
+// SIZE_MAX if there isn't one.
+static size_t edited_function(ast_program_t *program,
+                              const struct parser_edit *edit) {
+    // The last function starting at or before the edit.
+    size_t lo = 0, hi = program->nfunctions;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (function_begin(program, mid) <= edit->offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return SIZE_MAX;
+    }
+
+    size_t i = lo - 1;
+    uint32_t len = program->ordered[i]->end - program->ordered[i]->begin;
+    if (edit->offset + edit->len > function_begin(program, i) + len) {
+        return SIZE_MAX;
+    }
+    return i;
+}
+
+// Lexes and parses the ith function again, with the edit applied to it, and
+// replaces it in the program. Returns false, leaving the program as it was,
+// if the function can't be reparsed on its own.
+static bool reparse_function(struct ident_table *idents, const char *prog,
+                             const struct parser_edit *edit, size_t max_depth,
+                             ast_program_t *program, size_t i) {
+    // Bring the function up to date, and those before it.
+    if (program->shift == 0) {
+        program->shifted = i + 1;
+    } else if (program->shifted <= i) {
+        shift_functions(program, program->shifted, i + 1, program->shift);
+        program->shifted = i + 1;
+    }
+    ast_function_t *old = program->ordered[i];
+
+    // The function's new text is copied into the program, as its constants
+    // will point into it.
+    size_t before = edit->offset - old->begin;
+    size_t after = old->end - (edit->offset + edit->len);
+    size_t len = before + edit->text_len + after;
+    char *text = arena_alloc(program->arena, len);
+    memcpy(text, prog + old->begin, before);
+    memcpy(text + before, edit->text, edit->text_len);
+    memcpy(text + before + edit->text_len, prog + edit->offset + edit->len,
+           after);
+
+    struct tokens *tokens = tokens_lex(idents, text, len);
+    state_t state = {
+        .prog = text,
+        .idents = idents,
+        .arena = program->arena,
+        .tokens = tokens,
+        .pos = 0,
+        .max_depth = max_depth,
+    };
+    ast_function_t *function = alloc(&state, sizeof(ast_function_t));
+    bool reparsed = tokens->diags.len == 0 &&
+                    !iserror(parse_function(&state, function)) &&
+                    eof(&state) && function->end == len;
+    state_free(&state);
+    tokens_free(tokens);
+    if (!reparsed) {
+        return false;
+    }
+
+    function->begin += old->begin;
+    function->end += old->begin;
+    program->ordered[i] = function;
+
+    // TODO: Avoid ident_to_str if/when map can have arbitrary keys
+    const char *name = ident_to_str(old->ident);
+    if (map_get(program->functions, name) == old) {
+        map_remove(program->functions, name);
+    }
+    map_insert(program->functions, ident_to_str(function->ident), function);
+
+    // Those after it move by the change in length: the ones up to where the
+    // functions haven't been moved yet now, and the rest later.
+    uint32_t delta = (uint32_t)edit->text_len - (uint32_t)edit->len;
+    shift_functions(program, i + 1, program->shifted, delta);
+    program->shift += delta;
+
+    return true;
+}
+
+// Parses the whole of the edited source, into a new program which owns it.
+static parse_result_t reparse_program(struct ident_table *idents,
+                                      const char *prog, size_t len,
+                                      const struct parser_edit *edit,
+                                      const struct parser_options *opts,
+                                      ast_program_t *program) {
+    struct arena *arena = arena_new();
+    size_t after = len - (edit->offset + edit->len);
+    size_t edited_len = edit->offset + edit->text_len + after;
+    char *edited = arena_alloc(arena, edited_len);
+    memcpy(edited, prog, edit->offset);
+    memcpy(edited + edit->offset, edit->text, edit->text_len);
+    memcpy(edited + edit->offset + edit->text_len,
+           prog + edit->offset + edit->len, after);
+
+    struct parser_options eager = {0};
+    if (opts != NULL) {
+        eager = *opts;
+    }
+    eager.lazy_bodies = false;
+
+    struct tokens *tokens = tokens_lex(idents, edited, edited_len);
+    ast_program_t reparsed;
+    parse_result_t result =
+        parser_parse_tokens(idents, edited, tokens, &eager, &reparsed);
+    tokens_free(tokens);
+
+    ast_program_free(program);
+    if (iserror(result)) {
+        arena_free(arena);
+        return result;
+    }
+
+    arena_absorb(reparsed.arena, arena);
+    *program = reparsed;
+    return ok();
+}
+
+parse_result_t parser_reparse(struct ident_table *idents, const char *prog,
+                              size_t len, struct parser_edit edit,
+                              const struct parser_options *opts,
+                              ast_program_t *program) {
+    if (edit.offset > len || edit.len > len - edit.offset) {
+        diag_t diag = {.span = {.offset = len},
+                       .msg = "edit is outside the source"};
+        return (parse_result_t){.kind = Parse_Result_Error, .diag = diag};
+    }
+
+    size_t max_depth = opts != NULL && opts->max_depth != 0 ? opts->max_depth
+                                                            : PARSER_MAX_DEPTH;
+
+    // Bodies which were skipped would be parsed from the old tokens.
+    size_t i = program->lazy == NULL ? edited_function(program, &edit)
+                                     : SIZE_MAX;
+    if (i != SIZE_MAX &&
+        reparse_function(idents, prog, &edit, max_depth, program, i)) {
+        return ok();
+    }
+    return reparse_program(idents, prog, len, &edit, opts, program);
+}
+
+void parser_update_offsets(ast_program_t *program) {
+    shift_functions(program, program->shifted, program->nfunctions,
+                    program->shift);
+    program->shifted = program->nfunctions;
+    program->shift = 0;
 }
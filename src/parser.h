@@ -5,6 +5,7 @@
 #include "ast.h"
 #include "diag.h"
 #include "ident.h"
+#include "tokens.h"
 
 typedef struct {
     enum {
@@ -15,5 +16,87 @@ typedef struct {
     diag_t diag;
 } parse_result_t;
 
+// The default for parser_options.max_depth.
+#define PARSER_MAX_DEPTH 4096
+
+struct parser_options {
+    // How deeply statements may nest, and how many operators may be waiting
+    // for their right operands at once. Deeper input is an error. 0 means
+    // PARSER_MAX_DEPTH. This doesn't limit how deep expression trees are, as
+    // a chain of left-associative operators is as deep as it is long without
+    // any operators waiting, so passes over expressions mustn't recurse.
+    // Passes which recurse into statements rely on this limit.
+    size_t max_depth;
+    // Don't parse function bodies, only find their extent by matching
+    // braces. Each body is parsed when it's asked for, by
+    // parser_parse_body(). The source, tokens and ident table must then
+    // outlive the program.
+    bool lazy_bodies;
+    // If set, the parser doesn't stop at the first error. It reports each
+    // one here, skips to the end of the statement or function, and carries
+    // on, until the list is full. The result is still the first error.
+    struct diags *diags;
+    // Threads to parse function bodies with, once the functions have been
+    // found by matching braces. 0 or 1 parses them as they're found. Small
+    // programs are parsed serially regardless.
+    size_t jobs;
+};
+
+// Lexes all of prog up front, then parses it. prog need not be
+// NUL-terminated. The program's constants point into prog, so it must
+// outlive the program.
 parse_result_t parser_parse(struct ident_table *idents, const char *prog,
-                            ast_program_t *program);
+                            size_t len, ast_program_t *program);
+
+// Parses already-lexed tokens. The tokens aren't needed once this returns,
+// but prog is, as for parser_parse(). opts may be NULL, for the defaults.
+parse_result_t parser_parse_tokens(struct ident_table *idents,
+                                   const char *prog, struct tokens *tokens,
+                                   const struct parser_options *opts,
+                                   ast_program_t *program);
+
+// Parses the function's body, if it hasn't been already. Errors in a body
+// that was skipped are only found here.
+parse_result_t parser_parse_body(ast_program_t *program,
+                                 ast_function_t *function);
+
+// Parses every body that hasn't been already, returning the first error.
+// Unless the parser recovers from errors, it stops there. The passes which
+// walk function bodies need this first.
+parse_result_t parser_parse_bodies(ast_program_t *program);
+
+// A change to the source: the len bytes at offset are replaced by the
+// text_len bytes of text.
+struct parser_edit {
+    size_t offset;
+    size_t len;
+    const char *text;
+    size_t text_len;
+};
+
+// Updates a program for an edit to its source. prog is the source before the
+// edit. The result, and the program, are as if the edited source had been
+// parsed from scratch, so on error the program is freed.
+//
+// If the edit falls within one function, which still parses on its own,
+// only that function is lexed and parsed again: the others are kept as they
+// are, and the cost doesn't depend on the size of the source, so long as
+// the edits are near each other. Otherwise the whole of it is parsed again,
+// as it is after an edit which leaves an error.
+//
+// Text which is parsed again is copied into the program, so prog needn't
+// outlive this. Functions which aren't reparsed still point into the source
+// they were parsed from, so the source the program was first parsed from
+// must outlive it, but the sources edits were made to needn't. An edit
+// which doesn't fall within prog is an error, and leaves the program as it
+// was. Bodies are always parsed, rather than
+// skipped, and each edit grows the program's arena until it's parsed in
+// full again. opts is as for parser_parse_tokens(), and may be NULL.
+parse_result_t parser_reparse(struct ident_table *idents, const char *prog,
+                              size_t len, struct parser_edit edit,
+                              const struct parser_options *opts,
+                              ast_program_t *program);
+
+// Brings the begin and end of every function up to date, after edits.
+// parser_reparse() only moves them as it needs to.
+void parser_update_offsets(ast_program_t *program);
@@ -0,0 +1,235 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+// Not using <ctype.h>, which depends on the locale.
+static bool is_whitespace(char c) { return c == ' ' || c == '\t' || c == '\n'; }
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_ident(char c) {
+    return c == '_' || is_digit(c) || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z');
+}
+
+static const char *scalar_whitespace(const char *p, const char *end) {
+    while (p < end && is_whitespace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *scalar_ident(const char *p, const char *end) {
+    while (p < end && is_ident(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *scalar_digits(const char *p, const char *end) {
+    while (p < end && is_digit(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *scalar_newline(const char *p, const char *end) {
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+static const char *scalar_comment_end(const char *p, const char *end) {
+    while (p < end && !(*p == '*' && p + 1 < end && p[1] == '/')) {
+        p++;
+    }
+    return p;
+}
+
+const struct scan_kernels scan_kernels_scalar = {
+    .name = "scalar",
+    .whitespace = scalar_whitespace,
+    .ident = scalar_ident,
+    .digits = scalar_digits,
+    .newline = scalar_newline,
+    .comment_end = scalar_comment_end,
+};
+
+#if defined(SCAN_X86)
+
+// The vector kernels are written once, in terms of per-ISA functions which
+// classify a block of WIDTH bytes at p into a bitmask (bit i for byte i):
+//
+//   ISA_whitespace(p): whitespace bytes
+//   ISA_ident(p):      identifier bytes
+//   ISA_digits(p):     digits
+//   ISA_eq(p, c):      bytes equal to c
+//
+// Blocks are only loaded while they're entirely before end, and the scalar
+// kernels finish off the tail.
+#define DEFINE_KERNELS(ISA, WIDTH, ATTR)                                       \
+    ATTR static const char *ISA##_kernel_whitespace(const char *p,             \
+                                                    const char *end) {         \
+        for (; end - p >= WIDTH; p += WIDTH) {                                 \
+            uint32_t stop = ~ISA##_whitespace(p);                              \
+            if (stop) {                                                        \
+                return p + __builtin_ctz(stop);                                \
+            }                                                                  \
+        }                                                                      \
+        return scalar_whitespace(p, end);                                      \
+    }                                                                          \
+                                                                               \
+    ATTR static const char *ISA##_kernel_ident(const char *p,                  \
+                                               const char *end) {              \
+        for (; end - p >= WIDTH; p += WIDTH) {                                 \
+            uint32_t stop = ~ISA##_ident(p);                                   \
+            if (stop) {                                                        \
+                return p + __builtin_ctz(stop);                                \
+            }                                                                  \
+        }                                                                      \
+        return scalar_ident(p, end);                                           \
+    }                                                                          \
+                                                                               \
+    ATTR static const char *ISA##_kernel_digits(const char *p,                 \
+                                                const char *end) {             \
+        for (; end - p >= WIDTH; p += WIDTH) {                                 \
+            uint32_t stop = ~ISA##_digits(p);                                  \
+            if (stop) {                                                        \
+                return p + __builtin_ctz(stop);                                \
+            }                                                                  \
+        }                                                                      \
+        return scalar_digits(p, end);                                          \
+    }                                                                          \
+                                                                               \
+    ATTR static const char *ISA##_kernel_newline(const char *p,                \
+                                                 const char *end) {            \
+        for (; end - p >= WIDTH; p += WIDTH) {                                 \
+            uint32_t nl = ISA##_eq(p, '\n');                                   \
+            if (nl) {                                                          \
+                return p + __builtin_ctz(nl);                                  \
+            }                                                                  \
+        }                                                                      \
+        return scalar_newline(p, end);                                         \
+    }                                                                          \
+                                                                               \
+    ATTR static const char *ISA##_kernel_comment_end(const char *p,            \
+                                                     const char *end) {        \
+        for (; end - p >= WIDTH; p += WIDTH) {                                 \
+            uint32_t stars = ISA##_eq(p, '*');                                 \
+            for (; stars; stars &= stars - 1) {                                \
+                int i = __builtin_ctz(stars);                                  \
+                if (p + i + 1 < end && p[i + 1] == '/') {                      \
+                    return p + i;                                              \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+        return scalar_comment_end(p, end);                                     \
+    }                                                                          \
+                                                                               \
+    const struct scan_kernels scan_kernels_##ISA = {                           \
+        .name = #ISA,                                                          \
+        .whitespace = ISA##_kernel_whitespace,                                 \
+        .ident = ISA##_kernel_ident,                                           \
+        .digits = ISA##_kernel_digits,                                         \
+        .newline = ISA##_kernel_newline,                                       \
+        .comment_end = ISA##_kernel_comment_end,                               \
+    };
+
+// SSE2 is part of x86-64, so needs no target attribute.
+
+// Bytes in [lo, hi]. Bytes >= 0x80 are negative, so are never in range.
+static __m128i sse2_in_range(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+}
+
+static uint32_t sse2_mask(__m128i v) {
+    return (uint32_t)_mm_movemask_epi8(v) | 0xffff0000u;
+}
+
+static uint32_t sse2_eq(const char *p, char c) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+// The classifying functions set the unused high bits, so that inverting the
+// result only has bits set for bytes in the block.
+static uint32_t sse2_whitespace(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    __m128i newline = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    return sse2_mask(_mm_or_si128(blank, newline));
+}
+
+static uint32_t sse2_ident(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // Setting 0x20 folds upper case onto lower case.
+    __m128i alpha = sse2_in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a',
+                                  'z');
+    __m128i digit = sse2_in_range(v, '0', '9');
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return sse2_mask(_mm_or_si128(_mm_or_si128(alpha, digit), underscore));
+}
+
+static uint32_t sse2_digits(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return sse2_mask(sse2_in_range(v, '0', '9'));
+}
+
+DEFINE_KERNELS(sse2, 16, )
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i avx2_in_range(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2 static uint32_t avx2_eq(const char *p, char c) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+
+AVX2 static uint32_t avx2_whitespace(const char *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i blank =
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    __m256i newline = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    return _mm256_movemask_epi8(_mm256_or_si256(blank, newline));
+}
+
+AVX2 static uint32_t avx2_ident(const char *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i alpha =
+        avx2_in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = avx2_in_range(v, '0', '9');
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_or_si256(alpha, digit), underscore));
+}
+
+AVX2 static uint32_t avx2_digits(const char *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    return _mm256_movemask_epi8(avx2_in_range(v, '0', '9'));
+}
+
+DEFINE_KERNELS(avx2, 32, AVX2)
+
+#endif
+
+const struct scan_kernels *scan_select(void) {
+#if defined(SCAN_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        return &scan_kernels_avx2;
+    }
+    return &scan_kernels_sse2;
+#else
+    return &scan_kernels_scalar;
+#endif
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+
+// Kernels which find the end of the long runs of bytes that dominate real
+// sources: whitespace, identifiers, constants and comments. Each returns a
+// pointer into [p, end], and never reads outside it.
+
+struct scan_kernels {
+    const char *name;
+
+    // Returns the first byte which isn't ' ', '\t' or '\n'.
+    const char *(*whitespace)(const char *p, const char *end);
+    // Returns the first byte which isn't [A-Za-z0-9_].
+    const char *(*ident)(const char *p, const char *end);
+    // Returns the first byte which isn't [0-9].
+    const char *(*digits)(const char *p, const char *end);
+    // Returns the first '\n'. Also used to build the line index.
+    const char *(*newline)(const char *p, const char *end);
+    // Returns the start of the first "*/".
+    const char *(*comment_end)(const char *p, const char *end);
+};
+
+extern const struct scan_kernels scan_kernels_scalar;
+#if defined(__x86_64__)
+#define SCAN_X86
+extern const struct scan_kernels scan_kernels_sse2;
+extern const struct scan_kernels scan_kernels_avx2;
+#endif
+
+// Returns the fastest kernels supported by the CPU we're running on.
+const struct scan_kernels *scan_select(void);
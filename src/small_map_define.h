@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "map_define.h"
+
+// Typed maps for few entries, instantiated with:
+//
+//     SMALL_MAP_DEFINE(name, K, V, N, hash, eq)
+//
+// which defines struct name and static inline functions over it:
+//
+//     V *name_get(struct name *m, K key);
+//     void name_insert(struct name *m, K key, V value);
+//     size_t name_len(struct name *m);
+//     void name_free(struct name *m);
+//
+// Up to N entries are kept inline, in insertion order, and found by
+// comparing each key in turn with eq, which for a few keys is quicker than
+// hashing and doesn't allocate. The entry after that moves them all into a
+// map of MAP_DEFINE's, in the same storage, for good. A zeroed struct name
+// is an empty map. name_free() releases the table, but not the struct
+// itself.
+
+#define SMALL_MAP_DEFINE(NAME, K, V, N, HASH, EQ)                              \
+    MAP_DEFINE(NAME##_large, K, V, HASH, EQ)                                   \
+                                                                               \
+    struct NAME##_small {                                                      \
+        K keys[N];                                                             \
+        V values[N];                                                           \
+    };                                                                         \
+                                                                               \
+    struct NAME {                                                              \
+        /* Entries held inline, until the map is large. */                     \
+        uint32_t len;                                                          \
+        bool large;                                                            \
+        union {                                                                \
+            struct NAME##_small small;                                         \
+            struct NAME##_large map;                                           \
+        };                                                                     \
+    };                                                                         \
+                                                                               \
+    /* Returns a pointer to the value for key, or NULL. */                     \
+    static inline V *NAME##_get(struct NAME *m, K key) {                       \
+        if (m->large) {                                                        \
+            return NAME##_large_get(&m->map, key);                             \
+        }                                                                      \
+        for (uint32_t i = 0; i < m->len; i++) {                                \
+            if (EQ(m->small.keys[i], key)) {                                   \
+                return &m->small.values[i];                                    \
+            }                                                                  \
+        }                                                                      \
+        return NULL;                                                           \
+    }                                                                          \
+                                                                               \
+    static inline void NAME##_insert(struct NAME *m, K key, V value) {         \
+        if (!m->large) {                                                       \
+            V *existing = NAME##_get(m, key);                                  \
+            if (existing != NULL) {                                            \
+                *existing = value;                                             \
+                return;                                                        \
+            }                                                                  \
+            if (m->len < N) {                                                  \
+                m->small.keys[m->len] = key;                                   \
+                m->small.values[m->len] = value;                               \
+                m->len++;                                                      \
+                return;                                                        \
+            }                                                                  \
+                                                                               \
+            /* Full: the entries move out to make way for the map. */          \
+            struct NAME##_small small = m->small;                              \
+            m->map = (struct NAME##_large){0};                                 \
+            m->large = true;                                                   \
+            for (uint32_t i = 0; i < N; i++) {                                 \
+                NAME##_large_insert(&m->map, small.keys[i], small.values[i]);  \
+            }                                                                  \
+        }                                                                      \
+        NAME##_large_insert(&m->map, key, value);                              \
+    }                                                                          \
+                                                                               \
+    static inline size_t NAME##_len(struct NAME *m) {                          \
+        return m->large ? NAME##_large_len(&m->map) : m->len;                  \
+    }                                                                          \
+                                                                               \
+    static inline void NAME##_free(struct NAME *m) {                           \
+        if (m->large) {                                                        \
+            NAME##_large_free(&m->map);                                        \
+        }                                                                      \
+        *m = (struct NAME){0};                                                 \
+    }
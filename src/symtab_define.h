@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ident.h"
+#include "vec_define.h"
+
+// Typed symbol tables, for walking nested scopes in order, instantiated for a
+// value type with:
+//
+//     SYMTAB_DEFINE(name, T)
+//
+// which defines struct name and static inline functions over it:
+//
+//     void name_enter(struct name *t);
+//     void name_leave(struct name *t);
+//     void name_declare(struct name *t, struct ident *ident, T value);
+//     T *name_get(struct name *t, struct ident *ident);
+//     T *name_get_local(struct name *t, struct ident *ident);
+//     void name_free(struct name *t);
+//
+// Each ident has a stack of its bindings, innermost on top, which is found by
+// the ident's dense id. Looking a name up is an index into an array, however
+// deeply the scopes nest. The bindings themselves are kept in one array, in
+// the order they were declared, which doubles as the undo log: leaving a
+// scope pops the bindings declared since it was entered, uncovering whatever
+// each had shadowed.
+//
+// A scope can't be looked into once it's been left. A zeroed struct name is
+// an empty table, in its outermost scope. The same table is best reused from
+// one function to the next, as it has an entry for every ident up to the
+// highest id declared. name_free() releases the table, but not the struct
+// itself.
+
+// The binding of an ident that has none.
+#define SYMTAB_NONE UINT32_MAX
+
+#define SYMTAB_DEFINE(NAME, T)                                                 \
+    struct NAME##_binding {                                                    \
+        T value;                                                               \
+        uint32_t id;                                                           \
+        /* The binding of the same ident that this shadows. */                 \
+        uint32_t shadowed;                                                     \
+    };                                                                         \
+                                                                               \
+    VEC_DEFINE(NAME##_bindings, struct NAME##_binding)                         \
+    VEC_DEFINE(NAME##_marks, size_t)                                           \
+                                                                               \
+    struct NAME {                                                              \
+        /* Indexed by ident id, the index of its innermost binding. */         \
+        uint32_t *innermost;                                                   \
+        size_t nids;                                                           \
+        struct NAME##_bindings bindings;                                       \
+        /* For each scope entered, how many bindings there were. */            \
+        struct NAME##_marks marks;                                             \
+    };                                                                         \
+                                                                               \
+    static inline void NAME##_enter(struct NAME *t) {                          \
+        NAME##_marks_push(&t->marks, t->bindings.len);                         \
+    }                                                                          \
+                                                                               \
+    /* Leaves the innermost scope. One must have been entered. */              \
+    static inline void NAME##_leave(struct NAME *t) {                          \
+        size_t mark = NAME##_marks_pop(&t->marks);                             \
+        while (t->bindings.len > mark) {                                       \
+            struct NAME##_binding b = NAME##_bindings_pop(&t->bindings);       \
+            t->innermost[b.id] = b.shadowed;                                   \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    /* Shadows any binding of ident, even one in the same scope. */            \
+    static inline void NAME##_declare(struct NAME *t, struct ident *ident,     \
+                                      T value) {                               \
+        uint32_t id = ident_id(ident);                                         \
+        if (id >= t->nids) {                                                   \
+            size_t nids = t->nids == 0 ? 64 : t->nids * 2;                     \
+            if (nids <= id) {                                                  \
+                nids = (size_t)id + 1;                                         \
+            }                                                                  \
+            t->innermost = realloc(t->innermost, nids * sizeof(uint32_t));     \
+            memset(t->innermost + t->nids, 0xff,                               \
+                   (nids - t->nids) * sizeof(uint32_t));                       \
+            t->nids = nids;                                                    \
+        }                                                                      \
+                                                                               \
+        struct NAME##_binding b = {                                            \
+            .value = value,                                                    \
+            .id = id,                                                          \
+            .shadowed = t->innermost[id],                                      \
+        };                                                                     \
+        t->innermost[id] = NAME##_bindings_push(&t->bindings, b);              \
+    }                                                                          \
+                                                                               \
+    /* The innermost binding's value, or NULL. The pointer is valid until */   \
+    /* the next declaration. */                                                \
+    static inline T *NAME##_get(struct NAME *t, struct ident *ident) {         \
+        uint32_t id = ident_id(ident);                                         \
+        if (id >= t->nids || t->innermost[id] == SYMTAB_NONE) {                \
+            return NULL;                                                       \
+        }                                                                      \
+        return &t->bindings.data[t->innermost[id]].value;                      \
+    }                                                                          \
+                                                                               \
+    /* As name_get(), but only if declared in the innermost scope. */          \
+    static inline T *NAME##_get_local(struct NAME *t, struct ident *ident) {   \
+        size_t mark = t->marks.len > 0 ? t->marks.data[t->marks.len - 1] : 0;  \
+        uint32_t id = ident_id(ident);                                         \
+        if (id >= t->nids || t->innermost[id] == SYMTAB_NONE ||                \
+            t->innermost[id] < mark) {                                         \
+            return NULL;                                                       \
+        }                                                                      \
+        return &t->bindings.data[t->innermost[id]].value;                      \
+    }                                                                          \
+                                                                               \
+    static inline void NAME##_free(struct NAME *t) {                           \
+        free(t->innermost);                                                    \
+        NAME##_bindings_free(&t->bindings);                                    \
+        NAME##_marks_free(&t->marks);                                          \
+        *t = (struct NAME){0};                                                 \
+    }
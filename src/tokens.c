@@ -0,0 +1,359 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ident.h"
+#include "lexer.h"
+#include "tokens.h"
+
+// A guess at the number of tokens, so that most files don't need to grow
+// the arrays.
+#define BYTES_PER_TOKEN 4
+
+// Smaller chunks aren't worth a thread.
+#define MIN_CHUNK_SIZE (64 * 1024)
+
+struct builder {
+    struct tokens *tokens;
+    size_t capacity;
+};
+
+static void resize(struct tokens *tokens, size_t capacity) {
+    tokens->kinds = realloc(tokens->kinds, capacity * sizeof(uint8_t));
+    tokens->payloads = realloc(tokens->payloads, capacity * sizeof(uint32_t));
+    tokens->offsets = realloc(tokens->offsets, capacity * sizeof(uint32_t));
+    tokens->lens = realloc(tokens->lens, capacity * sizeof(uint32_t));
+}
+
+static struct builder builder_new(size_t bytes) {
+    struct builder b = {
+        .tokens = calloc(1, sizeof(struct tokens)),
+        .capacity = bytes / BYTES_PER_TOKEN + 2,
+    };
+    resize(b.tokens, b.capacity);
+    return b;
+}
+
+static void push(struct builder *b, uint8_t kind, uint32_t payload,
+                 uint32_t offset, uint32_t len) {
+    struct tokens *tokens = b->tokens;
+
+    // Always leave room for Token_Eof.
+    if (tokens->len + 2 > b->capacity) {
+        b->capacity *= 2;
+        resize(tokens, b->capacity);
+    }
+
+    size_t i = tokens->len++;
+    tokens->kinds[i] = kind;
+    tokens->payloads[i] = payload;
+    tokens->offsets[i] = offset;
+    tokens->lens[i] = len;
+}
+
+static uint32_t payload(token_t *token) {
+    switch (token->discrim) {
+    case Token_Keyword:
+        return token->keyword;
+    case Token_Identifier:
+        return ident_id(token->ident);
+    case Token_Punctuator:
+        return token->punctuator;
+    case Token_Constant:
+    case Token_Eof:
+        return 0;
+    }
+    return 0;
+}
+
+static void push_token(struct builder *b, token_t *token) {
+    push(b, token->discrim, payload(token), token->span.offset,
+         token->span.len);
+}
+
+// Adds the Token_Eof, at the point the lexer stopped.
+static struct tokens *finish(struct builder *b, lexer_state_t *lexer) {
+    struct tokens *tokens = b->tokens;
+    size_t i = tokens->len;
+
+    tokens->lexed = lexer->unlexed - lexer->prog;
+
+    tokens->kinds[i] = Token_Eof;
+    tokens->payloads[i] = 0;
+    tokens->offsets[i] = tokens->lexed;
+    tokens->lens[i] = 0;
+
+    return tokens;
+}
+
+// As lexer_next_token(), but reports characters which can't start a token,
+// and carries on after them. Returns false at the end, or if lexing can't
+// carry on, in which case lexer->error is set.
+static bool next_token(lexer_state_t *lexer, struct diags *diags,
+                       token_t *token) {
+    while (!lexer_next_token(lexer, token)) {
+        if (lexer->error == NULL) {
+            return false;
+        }
+
+        diag_t diag = {
+            .span = {.offset = lexer->unlexed - lexer->prog, .len = 1},
+            .msg = lexer->error,
+        };
+        if (!diags_report(diags, diag) || !lexer_skip_error(lexer)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct tokens *tokens_lex(struct ident_table *idents, const char *prog,
+                          size_t len) {
+    assert(len <= UINT32_MAX);
+    struct builder b = builder_new(len);
+
+    lexer_state_t lexer = lexer_new(idents, prog, len);
+    token_t token;
+    while (next_token(&lexer, &b.tokens->diags, &token)) {
+        push_token(&b, &token);
+    }
+
+    return finish(&b, &lexer);
+}
+
+// Lexing in parallel:
+//
+// The input is split into chunks which start just after a newline. Outside
+// of block comments, a newline always ends a token, so almost every chunk
+// starts between tokens and can be lexed independently. Each chunk is lexed
+// on its own thread, with its own ident table, and then the chunks' tokens
+// are stitched together in order, mapping their idents into the real table.
+//
+// A block comment can span a chunk boundary. The chunk it starts in stops
+// at the comment (unterminated), and the chunk after it has been lexed from
+// the middle of the comment, so can't be trusted. In that case we lex
+// serially from where the earlier chunk stopped, until we produce a token
+// which the later chunk also has: the lexer has no state between tokens, so
+// from then on the chunk's tokens are right.
+
+struct chunk {
+    const char *prog;
+    size_t begin, end;
+
+    struct ident_table *idents;
+    struct tokens *tokens;
+    // Where the lexer stopped. Less than end if it hit an error.
+    size_t lexed;
+};
+
+static void *lex_chunk(void *data) {
+    struct chunk *chunk = data;
+
+    struct builder b = builder_new(chunk->end - chunk->begin);
+    lexer_state_t lexer =
+        lexer_new_range(chunk->idents, chunk->prog, chunk->begin, chunk->end);
+    token_t token;
+    while (lexer_next_token(&lexer, &token)) {
+        push_token(&b, &token);
+    }
+    chunk->tokens = finish(&b, &lexer);
+    chunk->lexed = chunk->tokens->lexed;
+
+    return NULL;
+}
+
+// Returns the index of the chunk's token starting at offset, or SIZE_MAX.
+static size_t find_token(struct chunk *chunk, uint32_t offset) {
+    const uint32_t *offsets = chunk->tokens->offsets;
+    size_t lo = 0, hi = chunk->tokens->len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (offsets[mid] < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < chunk->tokens->len && offsets[lo] == offset) ? lo : SIZE_MAX;
+}
+
+// Appends the chunk's tokens from index i, with idents from the chunk's own
+// table mapped to the real one. Idents are only interned in the real table
+// when they're used, so that words lexed from the middle of a comment don't
+// end up in it.
+static void append_chunk(struct builder *b, struct ident_table *idents,
+                         struct chunk *chunk, size_t i) {
+    size_t nidents = ident_table_len(chunk->idents);
+    uint32_t *ids = malloc((nidents + 1) * sizeof(uint32_t));
+    memset(ids, 0xff, (nidents + 1) * sizeof(uint32_t));
+
+    struct tokens *from = chunk->tokens;
+    struct tokens *to = b->tokens;
+    size_t n = from->len - i;
+    while (to->len + n + 1 > b->capacity) {
+        b->capacity *= 2;
+        resize(to, b->capacity);
+    }
+
+    memcpy(to->kinds + to->len, from->kinds + i, n * sizeof(uint8_t));
+    memcpy(to->payloads + to->len, from->payloads + i, n * sizeof(uint32_t));
+    memcpy(to->offsets + to->len, from->offsets + i, n * sizeof(uint32_t));
+    memcpy(to->lens + to->len, from->lens + i, n * sizeof(uint32_t));
+
+    for (size_t j = to->len; j < to->len + n; j++) {
+        if (to->kinds[j] != Token_Identifier) {
+            continue;
+        }
+        uint32_t local = to->payloads[j];
+        if (ids[local] == UINT32_MAX) {
+            ids[local] = ident_id(ident_from_ident(
+                idents, ident_table_get(chunk->idents, local)));
+        }
+        to->payloads[j] = ids[local];
+    }
+    to->len += n;
+
+    free(ids);
+}
+
+static size_t split(const char *prog, size_t len, size_t nchunks,
+                    size_t *bounds) {
+    size_t n = 0;
+    bounds[n++] = 0;
+    for (size_t i = 1; i < nchunks; i++) {
+        size_t at = len / nchunks * i;
+        if (at <= bounds[n - 1]) {
+            continue;
+        }
+        const char *newline = memchr(prog + at, '\n', len - at);
+        if (newline == NULL) {
+            break;
+        }
+        at = newline + 1 - prog;
+        if (at > bounds[n - 1] && at < len) {
+            bounds[n++] = at;
+        }
+    }
+    bounds[n] = len;
+    return n;
+}
+
+struct tokens *tokens_lex_parallel(struct ident_table *idents,
+                                   const char *prog, size_t len,
+                                   size_t nthreads) {
+    size_t max_chunks = len / MIN_CHUNK_SIZE;
+    if (nthreads > max_chunks) {
+        nthreads = max_chunks;
+    }
+    if (nthreads <= 1) {
+        return tokens_lex(idents, prog, len);
+    }
+
+    size_t *bounds = malloc((nthreads + 1) * sizeof(size_t));
+    size_t nchunks = split(prog, len, nthreads, bounds);
+
+    struct chunk *chunks = calloc(nchunks, sizeof(struct chunk));
+    pthread_t *threads = malloc(nchunks * sizeof(pthread_t));
+    for (size_t i = 0; i < nchunks; i++) {
+        chunks[i] = (struct chunk){
+            .prog = prog,
+            .begin = bounds[i],
+            .end = bounds[i + 1],
+            .idents = ident_table_new(),
+        };
+        pthread_create(&threads[i], NULL, lex_chunk, &chunks[i]);
+    }
+    for (size_t i = 0; i < nchunks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    struct builder b = builder_new(len);
+    lexer_state_t lexer = lexer_new(idents, prog, len);
+    token_t token;
+    bool failed = false;
+
+    for (size_t i = 0; i < nchunks && !failed; i++) {
+        struct chunk *chunk = &chunks[i];
+        size_t from = 0;
+
+        // The previous chunk didn't finish at this one's start: catch up
+        // serially until we're back in step with this chunk.
+        if (lexer.unlexed != prog + chunk->begin) {
+            from = SIZE_MAX;
+            while (from == SIZE_MAX && lexer.unlexed < prog + chunk->end) {
+                if (!next_token(&lexer, &b.tokens->diags, &token)) {
+                    failed = lexer.error != NULL;
+                    break;
+                }
+                push_token(&b, &token);
+
+                size_t j = find_token(chunk, token.span.offset);
+                if (j != SIZE_MAX && chunk->tokens->lens[j] == token.span.len) {
+                    from = j + 1;
+                }
+            }
+            if (from == SIZE_MAX) {
+                continue;
+            }
+        }
+
+        append_chunk(&b, idents, chunk, from);
+
+        // If the chunk stopped early, carry on serially from where it
+        // stopped: either it's a real error, which we'll report and skip,
+        // or a comment running into the next chunk.
+        lexer.unlexed = prog + chunk->lexed;
+    }
+
+    // Whatever's left after the last chunk, including any error.
+    while (!failed && next_token(&lexer, &b.tokens->diags, &token)) {
+        push_token(&b, &token);
+    }
+
+    for (size_t i = 0; i < nchunks; i++) {
+        tokens_free(chunks[i].tokens);
+        ident_table_free(chunks[i].idents);
+    }
+    free(chunks);
+    free(threads);
+    free(bounds);
+
+    return finish(&b, &lexer);
+}
+
+void tokens_free(struct tokens *tokens) {
+    diags_free(&tokens->diags);
+    free(tokens->kinds);
+    free(tokens->payloads);
+    free(tokens->offsets);
+    free(tokens->lens);
+    free(tokens);
+}
+
+token_t tokens_get(struct tokens *tokens, struct ident_table *idents,
+                   size_t i) {
+    token_t token = {
+        .discrim = tokens->kinds[i],
+        .span = {.offset = tokens->offsets[i], .len = tokens->lens[i]},
+    };
+
+    switch (token.discrim) {
+    case Token_Keyword:
+        token.keyword = tokens->payloads[i];
+        break;
+    case Token_Identifier:
+        token.ident = ident_table_get(idents, tokens->payloads[i]);
+        break;
+    case Token_Punctuator:
+        token.punctuator = tokens->payloads[i];
+        break;
+    case Token_Constant:
+    case Token_Eof:
+        break;
+    }
+
+    return token;
+}
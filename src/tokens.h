@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "diag.h"
+#include "ident.h"
+#include "lexer.h"
+
+// A whole file's tokens, lexed up front. Each field of a token lives in its
+// own array, so that scanning the kinds (which is most of what the parser
+// does) only touches the kinds.
+//
+// kinds[len] is always Token_Eof, with the offset of the end of the lexed
+// input, so it's safe to look one token past the end.
+struct tokens {
+    // token_discrim_t
+    uint8_t *kinds;
+    // Token_Keyword: token_keyword_t
+    // Token_Identifier: ident_id() of the ident
+    // Token_Punctuator: token_punctuator_t
+    uint32_t *payloads;
+    // The token's span:
+    uint32_t *offsets;
+    uint32_t *lens;
+
+    size_t len;
+
+    // How much of the input was lexed. Less than the length of the input if
+    // the lexer had to stop: at an unterminated comment, or after too many
+    // errors.
+    uint32_t lexed;
+    // Characters which couldn't be lexed. They're skipped, and lexing
+    // carries on after them.
+    struct diags diags;
+};
+
+// prog must be at most UINT32_MAX bytes, as token offsets are 32-bit.
+struct tokens *tokens_lex(struct ident_table *idents, const char *prog,
+                          size_t len);
+// As tokens_lex(), but splits large inputs into chunks which are lexed on up
+// to nthreads threads. The result is the same as tokens_lex(), except that
+// idents may be numbered differently.
+struct tokens *tokens_lex_parallel(struct ident_table *idents,
+                                   const char *prog, size_t len,
+                                   size_t nthreads);
+void tokens_free(struct tokens *tokens);
+
+// Returns the i'th token, for use with the lexer_* functions.
+token_t tokens_get(struct tokens *tokens, struct ident_table *idents,
+                   size_t i);
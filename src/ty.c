@@ -1,12 +1,83 @@
 #include <stdlib.h>
 
+#include "arena.h"
 #include "ast.h"
 #include "common.h"
 #include "diag.h"
 #include "ident.h"
+#include "layout.h"
 #include "map.h"
+#include "map_define.h"
 #include "pprint.h"
 #include "ty.h"
+#include "vec_define.h"
+
+#define NBASIC (BasicTy_LongInt + 1)
+
+// Pointer types, keyed by the interned type they point to.
+MAP_DEFINE(ty_pointer_map, struct ty *, struct ty *, map_hash_ptr, map_eq_ptr)
+VEC_DEFINE(ty_vec, struct ty *)
+
+struct ty_table {
+    struct ty basic[NBASIC];
+    struct ty_pointer_map pointers;
+    // Structs and unions, whose members and lookups are freed with the table.
+    struct ty_vec records;
+    // Every type but the basic ones.
+    struct arena *arena;
+};
+
+struct ty_table *ty_table_new() {
+    struct ty_table *t = calloc(1, sizeof(struct ty_table));
+    for (size_t i = 0; i < NBASIC; i++) {
+        t->basic[i].kind = Ty_Basic;
+        t->basic[i].basic = i;
+    }
+    t->arena = arena_new();
+    return t;
+}
+
+void ty_table_free(struct ty_table *t) {
+    for (size_t i = 0; i < t->records.len; i++) {
+        struct ty *ty = t->records.data[i];
+        free(ty->members);
+        ty_member_map_free(&ty->lookup);
+        if (ty->layout != NULL) {
+            layout_free(ty->layout);
+        }
+    }
+    ty_vec_free(&t->records);
+    ty_pointer_map_free(&t->pointers);
+    arena_free(t->arena);
+    free(t);
+}
+
+struct ty *ty_basic(struct ty_table *t, enum basic_ty basic) {
+    return &t->basic[basic];
+}
+
+struct ty *ty_pointer(struct ty_table *t, struct ty *inner) {
+    struct ty **existing = ty_pointer_map_get(&t->pointers, inner);
+    if (existing != NULL) {
+        return *existing;
+    }
+
+    struct ty *ty = arena_alloc(t->arena, sizeof(struct ty));
+    ty->kind = Ty_Pointer;
+    ty->layout = NULL;
+    ty->inner = inner;
+    ty_pointer_map_insert(&t->pointers, inner, ty);
+    return ty;
+}
+
+struct ty *ty_struct_union(struct ty_table *t, enum ty_kind kind,
+                           struct ident *tag) {
+    struct ty *ty = arena_calloc(t->arena, sizeof(struct ty));
+    ty->kind = kind;
+    ty->tag = tag;
+    ty_vec_push(&t->records, ty);
+    return ty;
+}
 
 static const char *_basic(enum basic_ty ty) {
     switch (ty) {
@@ -18,6 +89,8 @@ static const char *_basic(enum basic_ty ty) {
         return "int";
     case BasicTy_LongInt:
         return "long";
+    default:
+        return "UNKNOWN_TY";
     }
 }
 
@@ -76,5 +149,5 @@ void ty_pprint(struct pprint *pp, struct ty *ty) {
     }
 }
 
-bool ty_compatible(struct ty *a, struct ty *b) { return a->kind == b->kind; }
+bool ty_compatible(struct ty *a, struct ty *b) { return a == b; }
 
@@ -3,8 +3,9 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
-#include "map.h"
+#include "ident.h"
 #include "pprint.h"
+#include "small_map_define.h"
 
 enum basic_ty {
     BasicTy_Char,
@@ -28,14 +29,23 @@ enum basic_ty {
 
 struct ty_member;
 
+// Structs and unions mostly have a few members, which are kept inline. Every
+// type has room for them, so fewer fit than in a scope.
+SMALL_MAP_DEFINE(ty_member_map, struct ident *, struct ty_member *, 4,
+                 map_hash_ptr, map_eq_ptr)
+
+struct layout;
+
 struct ty {
-    enum {
+    enum ty_kind {
         Ty_Basic,
         Ty_Pointer,
         Ty_Struct,
         Ty_Union,
         Ty_Incomplete,
     } kind;
+    // Set by layout_ty(), the first time it's needed.
+    struct layout *layout;
     union {
         enum basic_ty basic;
         // Ty_Pointer:
@@ -52,11 +62,10 @@ struct ty {
             struct ty_member *members;
             size_t nmembers;
 
-            // map[struct ident*]struct ty_member*
             // Non-owning. Allows efficient lookup of type for a member's ident
             // which is useful for type-checking. Anonymous members' members are
             // inlined into this lookup.
-            struct map *lookup;
+            struct ty_member_map lookup;
         };
     };
 };
@@ -69,6 +78,23 @@ struct ty_member {
     // span
 };
 
+// Interns types, so that there's one struct ty for each type and types can
+// be compared by pointer. Types are never freed or moved until the whole table
+// is freed, so they outlive the type checker that made them.
+struct ty_table;
+
+struct ty_table *ty_table_new();
+void ty_table_free(struct ty_table *t);
+
+struct ty *ty_basic(struct ty_table *t, enum basic_ty basic);
+struct ty *ty_pointer(struct ty_table *t, struct ty *inner);
+// Each struct or union definition is a type of its own, even if another has
+// the same members, so they aren't looked up. Returns a new type with no
+// members, which the caller fills in.
+struct ty *ty_struct_union(struct ty_table *t, enum ty_kind kind,
+                           struct ident *tag);
+
 void ty_pprint(struct pprint *pp, struct ty *ty);
+// Only interned types can be compared.
 bool ty_compatible(struct ty *a, struct ty *b);
 
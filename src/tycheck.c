@@ -4,33 +4,38 @@
 #include "common.h"
 #include "diag.h"
 #include "ident.h"
-#include "layout.h"
-#include "map.h"
-#include "scope.h"
+#include "symtab_define.h"
 #include "ty.h"
-#include "vec.h"
+#include "vec_define.h"
+
+VEC_DEFINE(ty_member_vec, struct ty_member)
+
+// The type of each name in scope. The AST is annotated with types as it's
+// checked, so nothing needs to look into a scope once it's been left.
+SYMTAB_DEFINE(ty_namespace, struct ty *)
 
 struct tycheck {
+    struct ty_table *types;
     struct {
-        struct scope *tags;
-        struct scope *ordinary;
+        struct ty_namespace tags;
+        struct ty_namespace ordinary;
     } namespaces;
 };
 
-struct tycheck *tycheck_new() {
-    struct tycheck *tyc = malloc(sizeof(struct tycheck));
-    tyc->namespaces.tags = scope_new();
-    tyc->namespaces.ordinary = scope_new();
+struct tycheck *tycheck_new(struct ty_table *types) {
+    struct tycheck *tyc = calloc(1, sizeof(struct tycheck));
+    tyc->types = types;
     return tyc;
 }
 
 void tycheck_free(struct tycheck *tyc) {
-    // TODO: free scope
-    // scope_free(tyc->scope);
+    ty_namespace_free(&tyc->namespaces.tags);
+    ty_namespace_free(&tyc->namespaces.ordinary);
     free(tyc);
 }
 
-static struct ty *ty_from_ast_basic(enum ast_basic_type ast_basic) {
+static struct ty *ty_from_ast_basic(struct tycheck *tyc,
+                                    enum ast_basic_type ast_basic) {
     enum basic_ty basic;
 
     switch (ast_basic) {
@@ -48,25 +53,16 @@ static struct ty *ty_from_ast_basic(enum ast_basic_type ast_basic) {
         break;
     }
 
-    struct ty *ty = malloc(sizeof(struct ty));
-    ty->kind = Ty_Basic;
-    ty->basic = basic;
-
-    return ty;
+    return ty_basic(tyc->types, basic);
 }
 
-static void tycheck_struct_declarator(struct tycheck *tyc, struct vec *members,
+static void tycheck_struct_declarator(struct tycheck *tyc,
+                                      struct ty_member_vec *members,
                                       struct ty *ty,
                                       struct ast_declarator *decl) {
-    UNUSED(tyc);
-
     for (size_t i = 0; i < decl->npointers; i++) {
         // TODO: type qualifiers
-        struct ty *inner = ty;
-
-        ty = malloc(sizeof(struct ty));
-        ty->kind = Ty_Pointer;
-        ty->inner = inner;
+        ty = ty_pointer(tyc->types, ty);
     }
 
     struct ty_member member = {
@@ -74,7 +70,7 @@ static void tycheck_struct_declarator(struct tycheck *tyc, struct vec *members,
         .ident = decl->ident,
         .ty = ty,
     };
-    vec_append(members, &member);
+    ty_member_vec_push(members, member);
 
     // Annotate AST:
     decl->ty = ty;
@@ -82,7 +78,8 @@ static void tycheck_struct_declarator(struct tycheck *tyc, struct vec *members,
 
 static struct ty *tycheck_type(struct tycheck *tyc, struct ast_type *ast_ty);
 
-static void tycheck_struct_declaration(struct tycheck *tyc, struct vec *members,
+static void tycheck_struct_declaration(struct tycheck *tyc,
+                                       struct ty_member_vec *members,
                                        struct ast_struct_declaration *decl) {
     struct ty *ty = tycheck_type(tyc, &decl->type);
 
@@ -94,7 +91,7 @@ static void tycheck_struct_declaration(struct tycheck *tyc, struct vec *members,
             .ident = NULL,
             .ty = ty,
         };
-        vec_append(members, &anonymous);
+        ty_member_vec_push(members, anonymous);
     }
 
     for (size_t i = 0; i < decl->ndeclarators; i++) {
@@ -103,7 +100,8 @@ static void tycheck_struct_declaration(struct tycheck *tyc, struct vec *members,
 }
 
 static void tycheck_struct_construct_lookup(struct tycheck *tyc,
-                                            struct map *lookup, struct ty *ty) {
+                                            struct ty_member_map *lookup,
+                                            struct ty *ty) {
     // Construct a look-up from each member's ident to its type, including the
     // members of any anonymous members (or anonymous members' members, etc.)
     for (size_t i = 0; i < ty->nmembers; i++) {
@@ -116,52 +114,37 @@ static void tycheck_struct_construct_lookup(struct tycheck *tyc,
             // just a declaration and shouldn't be included in the lookup.
 
             // TODO: Check that the member doesn't already exist and error.
-            map_insert(lookup, member->ident, member);
+            ty_member_map_insert(lookup, member->ident, member);
         }
     }
 }
 
 static struct ty *tycheck_type_struct_union(struct tycheck *tyc,
                                             struct ast_type *ast_ty) {
-    struct vec *members = vec_new(sizeof(struct ty_member));
+    struct ty_member_vec members = {0};
     for (size_t i = 0; i < ast_ty->ndeclarations; i++) {
-        tycheck_struct_declaration(tyc, members, &ast_ty->declarations[i]);
+        tycheck_struct_declaration(tyc, &members, &ast_ty->declarations[i]);
     }
 
-    struct ty *ty = malloc(sizeof(struct ty));
-    ty->tag = ast_ty->ident;
-    ty->nmembers = vec_into_raw(members, (void **)&ty->members);
-    ty->lookup = map_new(map_key_pointer);
+    enum ty_kind kind = ast_ty->kind == Ast_Type_Struct ? Ty_Struct : Ty_Union;
+    struct ty *ty = ty_struct_union(tyc->types, kind, ast_ty->ident);
+    ty->nmembers = ty_member_vec_into_raw(&members, &ty->members);
 
-    if (ast_ty->kind == Ast_Type_Struct) {
-        ty->kind = Ty_Struct;
-    } else {
-        ty->kind = Ty_Union;
-    }
-
-    tycheck_struct_construct_lookup(tyc, ty->lookup, ty);
+    tycheck_struct_construct_lookup(tyc, &ty->lookup, ty);
 
     // If it's tagged, we declare a new type with the given tag. If it's
-    // untagged, we still pass ownership of the struct ty* to the current
-    // scope, but as it's not accessible it can't be used by anyone else.
-    struct scope *scope = tyc->namespaces.tags;
-    if (ty->tag == NULL) {
-        scope_take_ownership(scope, ty);
-    } else {
-        scope_declare(scope, ty->tag, ty);
+    // untagged, it can't be referred to again.
+    if (ty->tag != NULL) {
+        ty_namespace_declare(&tyc->namespaces.tags, ty->tag, ty);
     }
 
-    struct layout *layout = layout_ty(ty);
-    struct pprint *pp = pprint_new(stdout);
-    layout_pprint(pp, layout);
-
     return ty;
 }
 
 static struct ty *tycheck_type(struct tycheck *tyc, struct ast_type *ast_ty) {
     switch (ast_ty->kind) {
     case Ast_Type_BasicType:
-        return ty_from_ast_basic(ast_ty->basic);
+        return ty_from_ast_basic(tyc, ast_ty->basic);
 
     case Ast_Type_Union:
     case Ast_Type_Struct:
@@ -173,14 +156,10 @@ static void tycheck_declarator(struct tycheck *tyc, struct ty *ty,
                                struct ast_declarator *decl) {
     for (size_t i = 0; i < decl->npointers; i++) {
         // TODO: type qualifiers
-        struct ty *inner = ty;
-
-        ty = malloc(sizeof(struct ty));
-        ty->kind = Ty_Pointer;
-        ty->inner = inner;
+        ty = ty_pointer(tyc->types, ty);
     }
 
-    scope_declare(tyc->namespaces.ordinary, decl->ident, ty);
+    ty_namespace_declare(&tyc->namespaces.ordinary, decl->ident, ty);
 
     // Annotate AST:
     decl->ty = ty;
@@ -194,50 +173,61 @@ void tycheck_declaration(struct tycheck *tyc, struct ast_declaration *decl) {
 
         // TODO: type check expr if it exists
     }
-
-    struct pprint *pp = pprint_new(stdout);
-    pprintf(pp, "---\n");
-    ast_pprint_declaration(pp, decl);
-    pprintf(pp, "\n");
-    ty_pprint(pp, ty);
-    pprintf(pp, "\n");
-    pprint_free(pp);
 }
 
-static void tycheck_statement(struct tycheck *tyc, ast_statement_t *stmt) {
-    UNUSED(tyc);
-    UNUSED(stmt);
+static void tycheck_block(struct tycheck *tyc, struct ast_nodes *nodes,
+                          ast_block_t *block);
+
+static void tycheck_statement(struct tycheck *tyc, struct ast_nodes *nodes,
+                              ast_stmt_idx_t idx) {
+    ast_statement_t *stmt = &nodes->stmts[idx];
+
+    switch (stmt->kind) {
+    case Ast_Statement_If:
+        tycheck_statement(tyc, nodes, stmt->arm1);
+        if (stmt->arm2 != AST_NONE) {
+            tycheck_statement(tyc, nodes, stmt->arm2);
+        }
+        break;
+    case Ast_Statement_Block:
+        tycheck_block(tyc, nodes, &nodes->blocks[stmt->block]);
+        break;
+    case Ast_Statement_Return:
+    case Ast_Statement_Expr:
+        // TODO: type check expr
+        break;
+    }
 }
 
-static void tycheck_function(struct tycheck *tyc, ast_function_t *func) {
-    // TODO: enter functon scope.
+// Each block has a scope of its own, in both namespaces.
+static void tycheck_block(struct tycheck *tyc, struct ast_nodes *nodes,
+                          ast_block_t *block) {
+    ty_namespace_enter(&tyc->namespaces.tags);
+    ty_namespace_enter(&tyc->namespaces.ordinary);
 
-    for (size_t i = 0; i < func->block.nitems; i++) {
-        struct ast_block_item *item = &func->block.items[i];
+    for (size_t i = 0; i < block->nitems; i++) {
+        struct ast_block_item *item = &block->items[i];
 
         switch (item->kind) {
         case Ast_BlockItem_Declaration:
             tycheck_declaration(tyc, &item->decl);
             break;
         case Ast_BlockItem_Statement:
-            tycheck_statement(tyc, &item->stmt);
+            tycheck_statement(tyc, nodes, item->stmt);
             break;
         }
     }
-}
 
-static bool _tycheck_program_iter(void *context, const void *key, void *value) {
-    UNUSED(key);
-
-    struct tycheck *tyc = (struct tycheck *)context;
-    ast_function_t *func = (ast_function_t *)value;
-
-    tycheck_function(tyc, func);
+    ty_namespace_leave(&tyc->namespaces.tags);
+    ty_namespace_leave(&tyc->namespaces.ordinary);
+}
 
-    return true;
+static void tycheck_function(struct tycheck *tyc, ast_function_t *func) {
+    tycheck_block(tyc, &func->nodes, &func->block);
 }
 
 void tycheck_check(struct tycheck *tyc, ast_program_t *prog) {
-    map_iter(prog->functions, tyc, &_tycheck_program_iter);
+    for (size_t i = 0; i < prog->nfunctions; i++) {
+        tycheck_function(tyc, prog->ordered[i]);
+    }
 }
-
@@ -5,7 +5,8 @@
 
 struct tycheck;
 
-struct tycheck *tycheck_new();
+// Types are interned in types, which must outlive any AST that's checked.
+struct tycheck *tycheck_new(struct ty_table *types);
 void tycheck_free(struct tycheck *tyc);
 
 void tycheck_check(struct tycheck *tyc, ast_program_t *prog);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdlib.h>
+
+// Typed growable arrays, instantiated for an element type with:
+//
+//     VEC_DEFINE(name, T)
+//
+// which defines struct name and static inline functions over it:
+//
+//     size_t name_push(struct name *v, T elem);
+//     T name_pop(struct name *v);
+//     T *name_get(struct name *v, size_t idx);
+//     size_t name_len(struct name *v);
+//     size_t name_into_raw(struct name *v, T **out);
+//     void name_free(struct name *v);
+//
+// Elements are copied by assignment rather than memcpy() of a runtime size.
+// A zeroed struct name is an empty vec, which doesn't allocate until something
+// is pushed. name_free() releases the elements, but not the struct itself.
+
+#define VEC_DEFINE(NAME, T)                                                    \
+    struct NAME {                                                              \
+        T *data;                                                               \
+        size_t len;                                                            \
+        size_t capacity;                                                       \
+    };                                                                         \
+                                                                               \
+    static inline size_t NAME##_push(struct NAME *v, T elem) {                 \
+        /* Grow capacity exponentially. */                                     \
+        if (v->len == v->capacity) {                                           \
+            v->capacity = v->capacity == 0 ? 4 : v->capacity * 2;              \
+            v->data = realloc(v->data, v->capacity * sizeof(T));               \
+        }                                                                      \
+        v->data[v->len] = elem;                                                \
+        return v->len++;                                                       \
+    }                                                                          \
+                                                                               \
+    /* Removes and returns the last element. v must not be empty. */           \
+    static inline T NAME##_pop(struct NAME *v) { return v->data[--v->len]; }   \
+                                                                               \
+    static inline T *NAME##_get(struct NAME *v, size_t idx) {                  \
+        return &v->data[idx];                                                  \
+    }                                                                          \
+                                                                               \
+    static inline size_t NAME##_len(struct NAME *v) { return v->len; }         \
+                                                                               \
+    /* Hands the elements, shrunk to fit, to the caller. Leaves v empty. */    \
+    static inline size_t NAME##_into_raw(struct NAME *v, T **out) {            \
+        size_t len = v->len;                                                   \
+        *out = realloc(v->data, len * sizeof(T));                              \
+        *v = (struct NAME){0};                                                 \
+        return len;                                                            \
+    }                                                                          \
+                                                                               \
+    static inline void NAME##_free(struct NAME *v) {                           \
+        free(v->data);                                                         \
+        *v = (struct NAME){0};                                                 \
+    }
@@ -0,0 +1,94 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+
+#include "framework.h"
+
+TEST(alignment) {
+    struct arena *a = arena_new();
+
+    for (size_t size = 0; size < 100; size++) {
+        void *ptr = arena_alloc(a, size);
+        ASSERT((uintptr_t)ptr % alignof(max_align_t) == 0);
+    }
+
+    arena_free(a);
+}
+
+TEST(allocations_distinct) {
+    struct arena *a = arena_new();
+
+    // Enough to need several chunks, including large allocations which get
+    // their own chunk.
+    char *ptrs[1000];
+    for (size_t i = 0; i < 1000; i++) {
+        size_t size = (i % 10 == 0) ? 100000 : 100;
+        ptrs[i] = arena_alloc(a, size);
+        memset(ptrs[i], (char)i, size);
+    }
+
+    for (size_t i = 0; i < 1000; i++) {
+        ASSERT(ptrs[i][0] == (char)i);
+        ASSERT(ptrs[i][99] == (char)i);
+    }
+
+    arena_free(a);
+}
+
+TEST(calloc_and_copy) {
+    struct arena *a = arena_new();
+
+    int *zeroed = arena_calloc(a, 64 * sizeof(int));
+    for (size_t i = 0; i < 64; i++) {
+        ASSERT(zeroed[i] == 0);
+    }
+
+    const char *str = "hello";
+    char *copy = arena_copy(a, str, strlen(str) + 1);
+    ASSERT(copy != str);
+    ASSERT(strcmp(copy, str) == 0);
+
+    arena_free(a);
+}
+
+TEST(absorb) {
+    struct arena *a = arena_new();
+    struct arena *b = arena_new();
+
+    char *in_a = arena_alloc(a, 100);
+    memset(in_a, 'a', 100);
+    // Several chunks, including a large allocation.
+    char *in_b[100];
+    for (size_t i = 0; i < 100; i++) {
+        in_b[i] = arena_alloc(b, i == 50 ? 100000 : 1000);
+        memset(in_b[i], (char)i, 1000);
+    }
+    size_t used = arena_used(a) + arena_used(b);
+
+    arena_absorb(a, b);
+    arena_absorb(a, arena_new());
+    ASSERT(arena_used(a) == used);
+
+    // a carries on bump-allocating from its own chunk.
+    char *after = arena_alloc(a, 100);
+    ASSERT(after > in_a && after < in_a + 1000);
+    memset(after, 'z', 100);
+
+    ASSERT(in_a[99] == 'a');
+    for (size_t i = 0; i < 100; i++) {
+        ASSERT(in_b[i][0] == (char)i && in_b[i][999] == (char)i);
+    }
+
+    // An empty arena takes over the other's chunks.
+    struct arena *c = arena_new();
+    used = arena_used(a);
+    arena_absorb(c, a);
+    ASSERT(arena_used(c) == used);
+    ASSERT(in_a[0] == 'a' && after[0] == 'z');
+
+    arena_free(c);
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "gen.h"
+#include "ident.h"
+#include "parser.h"
+#include "tycheck.h"
+
+#include "framework.h"
+
+#define TERMS 1000000
+
+// Generating a long chain of operators, whose tree is as deep as the chain is
+// long.
+TEST(gen_deep_expr) {
+    static const char *ops[] = {" + ", " * ", " - ", " / ", " < ", " == "};
+
+    char *prog = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&prog, &len);
+    fprintf(f, "int main() { return 1");
+    for (size_t i = 0; i < TERMS; i++) {
+        fprintf(f, "%s%zu", ops[i % 6], i % 7 + 1);
+    }
+    fprintf(f, "; }\n");
+    fclose(f);
+
+    struct ident_table *idents = ident_table_new();
+    ast_program_t program;
+    parse_result_t result = parser_parse(idents, prog, len, &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+
+    FILE *out = fopen("/dev/null", "w");
+    ASSERT(gen_generate(out, program));
+    fclose(out);
+
+    ast_program_free(&program);
+    ident_table_free(idents);
+    free(prog);
+}
+
+static char *gen_to_string(struct ident_table *idents, const char *prog) {
+    ast_program_t program;
+    parse_result_t result =
+        parser_parse(idents, prog, strlen(prog), &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+
+    struct ty_table *types = ty_table_new();
+    struct tycheck *tyc = tycheck_new(types);
+    tycheck_check(tyc, &program);
+    tycheck_free(tyc);
+
+    char *str = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&str, &len);
+    ASSERT(gen_generate(f, program));
+    fclose(f);
+
+    ty_table_free(types);
+    ast_program_free(&program);
+    return str;
+}
+
+// A variable declared in a block shadows one outside it, only until the end
+// of the block, so renaming it makes no difference to the code.
+TEST(gen_shadowing) {
+    struct ident_table *idents = ident_table_new();
+    char *shadowed = gen_to_string(idents, "int main() {\n"
+                                           "    int a = 1;\n"
+                                           "    { int a = 2; a = a + 1; }\n"
+                                           "    return a;\n"
+                                           "}\n"
+                                           "int f() { int a; return a; }\n");
+    char *renamed = gen_to_string(idents, "int main() {\n"
+                                          "    int a = 1;\n"
+                                          "    { int b = 2; b = b + 1; }\n"
+                                          "    return a;\n"
+                                          "}\n"
+                                          "int f() { int b; return b; }\n");
+    ASSERT(strcmp(shadowed, renamed) == 0);
+
+    free(shadowed);
+    free(renamed);
+    ident_table_free(idents);
+}
+
+// Names used outside the block that declares them are an error, not a crash.
+TEST(gen_undeclared) {
+    static const char *progs[] = {
+        "int main() { return x; }\n",
+        "int main() { { int a = 1; } return a; }\n",
+        "int main() { int a; a = &b; return 0; }\n",
+    };
+
+    struct ident_table *idents = ident_table_new();
+    for (size_t i = 0; i < sizeof(progs) / sizeof(*progs); i++) {
+        ast_program_t program;
+        parse_result_t result =
+            parser_parse(idents, progs[i], strlen(progs[i]), &program);
+        ASSERT(result.kind == Parse_Result_Ok);
+
+        struct ty_table *types = ty_table_new();
+        struct tycheck *tyc = tycheck_new(types);
+        tycheck_check(tyc, &program);
+        tycheck_free(tyc);
+
+        FILE *out = fopen("/dev/null", "w");
+        ASSERT(!gen_generate(out, program));
+        fclose(out);
+
+        ty_table_free(types);
+        ast_program_free(&program);
+    }
+    ident_table_free(idents);
+}
@@ -1,3 +1,5 @@
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -30,3 +32,127 @@ TEST(add_same_twice) {
 
     ident_table_free(t);
 }
+
+TEST(from_strn) {
+    struct ident_table *t = ident_table_new();
+
+    // Not NUL-terminated after "one":
+    const char *src = "onetwo";
+    struct ident *one1 = ident_from_strn(t, src, 3, ident_hash(src, 3));
+    struct ident *one2 = ident_from_str(t, "one");
+    struct ident *onetwo = ident_from_str(t, src);
+
+    ASSERT(ident_table_len(t) == 2);
+    ASSERT(one1 == one2);
+    ASSERT(one1 != onetwo);
+    ASSERT(strcmp("one", ident_to_str(one1)) == 0);
+    ASSERT(strcmp("onetwo", ident_to_str(onetwo)) == 0);
+
+    // A prefix of an interned string is a different ident.
+    struct ident *on = ident_from_strn(t, src, 2, ident_hash(src, 2));
+    ASSERT(ident_table_len(t) == 3);
+    ASSERT(strcmp("on", ident_to_str(on)) == 0);
+
+    ident_table_free(t);
+}
+
+#define THREADS 8
+#define WORDS 4096
+
+struct intern_worker {
+    struct ident_table *t;
+    size_t start;
+    struct ident *idents[WORDS];
+};
+
+// Interns every word, starting at a different place in each thread.
+static void *intern_all(void *data) {
+    struct intern_worker *w = data;
+    for (size_t i = 0; i < WORDS; i++) {
+        size_t j = (w->start + i) % WORDS;
+        char str[16];
+        snprintf(str, sizeof(str), "w%zu", j);
+        w->idents[j] = ident_from_str(w->t, str);
+    }
+    return NULL;
+}
+
+TEST(concurrent) {
+    struct ident_table *t = ident_table_new();
+
+    static struct intern_worker workers[THREADS];
+    pthread_t threads[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        workers[i] = (struct intern_worker){.t = t, .start = WORDS / 3 * i};
+        pthread_create(&threads[i], NULL, intern_all, &workers[i]);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    ASSERT(ident_table_len(t) == WORDS);
+
+    // Every thread got the same ident for each word, and the ids are dense.
+    bool seen[WORDS] = {false};
+    for (size_t j = 0; j < WORDS; j++) {
+        struct ident *ident = workers[0].idents[j];
+        for (size_t i = 1; i < THREADS; i++) {
+            ASSERT(workers[i].idents[j] == ident);
+        }
+
+        char str[16];
+        snprintf(str, sizeof(str), "w%zu", j);
+        ASSERT(strcmp(ident_to_str(ident), str) == 0);
+
+        uint32_t id = ident_id(ident);
+        ASSERT(id < WORDS && !seen[id]);
+        seen[id] = true;
+        ASSERT(ident_table_get(t, id) == ident);
+    }
+
+    ident_table_free(t);
+}
+
+TEST(from_ident) {
+    struct ident_table *a = ident_table_new();
+    struct ident_table *b = ident_table_new();
+
+    struct ident *x = ident_from_str(a, "x");
+    struct ident *long_name = ident_from_str(a, "a_rather_longer_name");
+
+    ASSERT(ident_len(x) == 1);
+    ASSERT(ident_len(long_name) == 20);
+
+    struct ident *y = ident_from_str(b, "y");
+    struct ident *long_name_b = ident_from_ident(b, long_name);
+    ASSERT(long_name_b != long_name);
+    ASSERT(long_name_b == ident_from_str(b, "a_rather_longer_name"));
+    ASSERT(ident_id(y) == 0 && ident_id(long_name_b) == 1);
+
+    ident_table_free(b);
+    ident_table_free(a);
+}
+
+// Enough strings to fill several of the blocks they're copied into, and
+// several segments of idents, without any of them moving.
+TEST(many_idents) {
+    struct ident_table *t = ident_table_new();
+
+    static struct ident *idents[20000];
+    char str[64];
+    for (size_t i = 0; i < 20000; i++) {
+        snprintf(str, sizeof(str), "ident_number_%zu", i);
+        idents[i] = ident_from_str(t, str);
+    }
+
+    ASSERT(ident_table_len(t) == 20000);
+    for (size_t i = 0; i < 20000; i++) {
+        snprintf(str, sizeof(str), "ident_number_%zu", i);
+        ASSERT(strcmp(ident_to_str(idents[i]), str) == 0);
+        ASSERT(ident_len(idents[i]) == strlen(str));
+        ASSERT(ident_table_get(t, i) == idents[i]);
+        ASSERT(ident_from_str(t, str) == idents[i]);
+    }
+
+    ident_table_free(t);
+}
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "ident.h"
+#include "layout.h"
+#include "parser.h"
+#include "ty.h"
+#include "tycheck.h"
+
+#include "framework.h"
+
+// A struct's layout is computed once, and finds members by ident, including
+// those of anonymous members.
+TEST(layout_lookup) {
+    static const char *prog = "int main() {\n"
+                              "    struct s {\n"
+                              "        char c;\n"
+                              "        int *p;\n"
+                              "        struct { short a; long b; };\n"
+                              "    } x;\n"
+                              "    return 0;\n"
+                              "}\n";
+
+    struct ident_table *idents = ident_table_new();
+    ast_program_t program;
+    parse_result_t result =
+        parser_parse(idents, prog, strlen(prog), &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+
+    struct ty_table *types = ty_table_new();
+    struct tycheck *tyc = tycheck_new(types);
+    tycheck_check(tyc, &program);
+    tycheck_free(tyc);
+
+    struct ty *ty = program.ordered[0]->block.items[0].decl.declarators[0].ty;
+    struct layout *layout = layout_ty(ty);
+    ASSERT(layout_ty(ty) == layout);
+    ASSERT(layout->size == 32 && layout->alignment == 8);
+
+    static const struct {
+        const char *name;
+        size_t offset, size;
+    } members[] = {{"c", 0, 1}, {"p", 8, 8}, {"a", 16, 2}, {"b", 24, 8}};
+    for (size_t i = 0; i < sizeof(members) / sizeof(*members); i++) {
+        struct layout_member *member =
+            layout_lookup(layout, ident_from_str(idents, members[i].name));
+        ASSERT(member != NULL);
+        ASSERT(member->offset == members[i].offset);
+        ASSERT(member->layout->size == members[i].size);
+    }
+    ASSERT(layout_lookup(layout, ident_from_str(idents, "x")) == NULL);
+
+    struct ty *pointer = ty_pointer(types, ty);
+    ASSERT(layout_ty(pointer)->size == 8);
+    ASSERT(layout_ty(pointer) == layout_ty(pointer));
+
+    ty_table_free(types);
+    ast_program_free(&program);
+    ident_table_free(idents);
+}
+
+// Incomplete types have no layout, and nor does anything containing one.
+TEST(layout_incomplete) {
+    struct ty_table *types = ty_table_new();
+    struct ty incomplete = {.kind = Ty_Incomplete};
+    ASSERT(layout_ty(&incomplete) == NULL);
+    // The lack of a layout is cached, rather than recomputed each time.
+    struct layout *cached = incomplete.layout;
+    ASSERT(cached != NULL);
+    ASSERT(layout_ty(&incomplete) == NULL);
+    ASSERT(incomplete.layout == cached);
+
+    struct ty *ty = ty_struct_union(types, Ty_Struct, NULL);
+    ty->nmembers = 2;
+    ty->members = calloc(2, sizeof(struct ty_member));
+    ty->members[0].ty = ty_basic(types, BasicTy_Int);
+    ty->members[1].ty = &incomplete;
+    ASSERT(layout_ty(ty) == NULL);
+    ASSERT(ty->layout == cached);
+
+    // A pointer to one is complete, though.
+    struct ty *ptr = ty_struct_union(types, Ty_Struct, NULL);
+    ptr->nmembers = 2;
+    ptr->members = calloc(2, sizeof(struct ty_member));
+    ptr->members[0].ty = ty_basic(types, BasicTy_Int);
+    ptr->members[1].ty = ty_pointer(types, &incomplete);
+    ASSERT(layout_ty(ptr) != NULL && layout_ty(ptr)->size == 16);
+
+    ty_table_free(types);
+}
@@ -1,7 +1,11 @@
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ast.h"
 #include "ident.h"
+#include "lines.h"
 #include "parser.h"
 
 #include "common.h"
@@ -13,10 +17,10 @@ static void lsnapshotter(FILE *f, void *data) {
 
     struct ident_table *idents = ident_table_new();
 
-    lexer_state_t state = lexer_new(idents, prog);
+    lexer_state_t state = lexer_new(idents, prog, strlen(prog));
     token_t token;
     while (lexer_next_token(&state, &token)) {
-        lexer_print_token(f, token);
+        lexer_print_token(f, prog, token);
     }
 
     ident_table_free(idents);
@@ -37,6 +41,91 @@ LEXER_TEST(keywords, "char short int long return if else struct union const\n")
 
 LEXER_TEST(identifiers_not_keywords, "e i\n")
 
-// TODO: Why is 0 skipped?
 LEXER_TEST(constants, "1 123 0")
 
+LEXER_TEST(comments, "a // b c\n"
+                     "d /* e\n"
+                     "f */ g /**/ h\n"
+                     "i / j /= k // l")
+
+TEST(lines) {
+    const char *prog = "a\n"
+                       "  /* \n */ b\n"
+                       "\n"
+                       "    c // d\n"
+                       "e";
+
+    struct ident_table *idents = ident_table_new();
+    lexer_state_t state = lexer_new(idents, prog, strlen(prog));
+
+    struct lines *lines = lines_new(prog, strlen(prog));
+
+    unsigned int expected[][2] = {{0, 0}, {2, 4}, {4, 4}, {5, 0}};
+    for (size_t i = 0; i < 4; i++) {
+        token_t token;
+        ASSERT(lexer_next_token(&state, &token));
+
+        unsigned int line, column;
+        lines_position(lines, token.span.offset, &line, &column);
+        ASSERT(line == expected[i][0]);
+        ASSERT(column == expected[i][1]);
+    }
+
+    lines_free(lines);
+    ident_table_free(idents);
+}
+
+// Counting allocations relies on replacing glibc's malloc, which a sanitizer's
+// allocator would conflict with.
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+
+// Every call into the allocator made by the test binary. Other tests lex on
+// several threads, so it's atomic.
+static atomic_size_t allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    atomic_fetch_add(&allocations, 1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    atomic_fetch_add(&allocations, 1);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add(&allocations, 1);
+    return __libc_realloc(ptr, size);
+}
+
+static void lex_all(struct ident_table *idents, const char *prog) {
+    lexer_state_t state = lexer_new(idents, prog, strlen(prog));
+    token_t token;
+    while (lexer_next_token(&state, &token)) {
+    }
+}
+
+// Tokens point back into the source, so lexing shouldn't allocate. The only
+// exception is the first time an identifier is interned.
+TEST(no_allocations_per_token) {
+    const char *prog = "int main() { long a = 1 + 23 * b; return a->c; }\n";
+
+    struct ident_table *idents = ident_table_new();
+    lex_all(idents, prog);
+
+    // Counting calls, rather than bytes in use, also catches memory which is
+    // allocated and then freed again.
+    size_t before = atomic_load(&allocations);
+    for (size_t i = 0; i < 1000; i++) {
+        lex_all(idents, prog);
+    }
+    ASSERT(atomic_load(&allocations) == before);
+
+    ident_table_free(idents);
+}
+
+#endif
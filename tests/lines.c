@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lines.h"
+
+#include "framework.h"
+
+static void assert_position(struct lines *lines, uint32_t offset,
+                            unsigned int line, unsigned int column) {
+    unsigned int actual_line, actual_column;
+    lines_position(lines, offset, &actual_line, &actual_column);
+    ASSERT(actual_line == line);
+    ASSERT(actual_column == column);
+}
+
+TEST(positions) {
+    const char *prog = "ab\n"
+                       "\n"
+                       "cde\n"
+                       "f";
+    struct lines *lines = lines_new(prog, strlen(prog));
+
+    ASSERT(lines_len(lines) == 4);
+    assert_position(lines, 0, 0, 0);
+    assert_position(lines, 1, 0, 1);
+    // A newline belongs to the line it ends:
+    assert_position(lines, 2, 0, 2);
+    assert_position(lines, 3, 1, 0);
+    assert_position(lines, 4, 2, 0);
+    assert_position(lines, 6, 2, 2);
+    assert_position(lines, 8, 3, 0);
+    // One past the end, for errors at EOF:
+    assert_position(lines, 9, 3, 1);
+
+    lines_free(lines);
+}
+
+TEST(empty) {
+    struct lines *lines = lines_new("", 0);
+    ASSERT(lines_len(lines) == 1);
+    assert_position(lines, 0, 0, 0);
+    lines_free(lines);
+}
+
+// Long enough for the vector kernels to be used.
+TEST(many_lines) {
+    char prog[1000];
+    for (size_t i = 0; i < sizeof(prog); i++) {
+        prog[i] = (i % 7 == 6) ? '\n' : 'x';
+    }
+    struct lines *lines = lines_new(prog, sizeof(prog));
+
+    ASSERT(lines_len(lines) == sizeof(prog) / 7 + 1);
+    for (uint32_t offset = 0; offset < sizeof(prog); offset++) {
+        assert_position(lines, offset, offset / 7, offset % 7);
+    }
+
+    lines_free(lines);
+}
@@ -1,7 +1,12 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "map.h"
+#include "map_define.h"
+#include "small_map_define.h"
+#include "vec_define.h"
 
 #include "framework.h"
 
@@ -54,3 +59,218 @@ TEST(pointer_keys) {
     ASSERT(strcmp(map_get(m, key1b), value4) == 0);
 }
 
+static bool count_iter(void *context, const void *key, void *value) {
+    size_t *count = context;
+    (*count)++;
+    ASSERT((uintptr_t)key == (uintptr_t)value);
+    return true;
+}
+
+TEST(many_keys) {
+    // Enough keys to resize the map several times.
+    size_t n = 10000;
+    char *keys = malloc(n);
+
+    struct map *m = map_new(map_key_pointer);
+    for (size_t i = 0; i < n; i++) {
+        map_insert(m, &keys[i], &keys[i]);
+    }
+    ASSERT(map_len(m) == n);
+
+    for (size_t i = 0; i < n; i++) {
+        ASSERT(map_get(m, &keys[i]) == &keys[i]);
+    }
+
+    size_t count = 0;
+    ASSERT(map_iter(m, &count, count_iter));
+    ASSERT(count == n);
+
+    map_free(m);
+    free(keys);
+}
+
+TEST(remove) {
+    size_t n = 1000;
+    char *keys = malloc(n);
+
+    struct map *m = map_new(map_key_pointer);
+    for (size_t i = 0; i < n; i++) {
+        map_insert(m, &keys[i], &keys[i]);
+    }
+
+    // Remove every other key.
+    for (size_t i = 0; i < n; i += 2) {
+        map_remove(m, &keys[i]);
+    }
+    ASSERT(map_len(m) == n / 2);
+
+    for (size_t i = 0; i < n; i++) {
+        void *expected = (i % 2 == 0) ? NULL : &keys[i];
+        ASSERT(map_get(m, &keys[i]) == expected);
+    }
+
+    // Removing a missing key does nothing.
+    map_remove(m, &keys[0]);
+    ASSERT(map_len(m) == n / 2);
+
+    // Churn through tombstones: repeatedly remove and re-insert.
+    for (size_t round = 0; round < 10; round++) {
+        for (size_t i = 0; i < n; i += 2) {
+            map_insert(m, &keys[i], &keys[i]);
+        }
+        for (size_t i = 0; i < n; i += 2) {
+            map_remove(m, &keys[i]);
+        }
+    }
+    ASSERT(map_len(m) == n / 2);
+    for (size_t i = 1; i < n; i += 2) {
+        ASSERT(map_get(m, &keys[i]) == &keys[i]);
+    }
+
+    map_free(m);
+    free(keys);
+}
+
+TEST(get_or_insert) {
+    char *key1 = "one", *key2 = "two";
+    char *key1b = strdup(key1);
+
+    struct map *m = map_new(map_key_string);
+
+    bool inserted;
+    void **value = map_get_or_insert(m, key1, &inserted);
+    ASSERT(inserted);
+    ASSERT(*value == NULL);
+    *value = key2;
+
+    value = map_get_or_insert(m, key1b, &inserted);
+    ASSERT(!inserted);
+    ASSERT(*value == key2);
+    ASSERT(map_len(m) == 1);
+
+    ASSERT(map_get(m, key1) == key2);
+
+    map_free(m);
+}
+
+MAP_DEFINE(test_map, const char *, size_t, map_hash_ptr, map_eq_ptr)
+
+TEST(typed_map) {
+    size_t n = 10000;
+    char *keys = malloc(n);
+
+    // A zeroed map is empty.
+    struct test_map m = {0};
+    ASSERT(test_map_len(&m) == 0);
+    ASSERT(test_map_get(&m, &keys[0]) == NULL);
+
+    for (size_t i = 0; i < n; i++) {
+        test_map_insert(&m, &keys[i], i);
+    }
+    ASSERT(test_map_len(&m) == n);
+
+    for (size_t i = 0; i < n; i++) {
+        ASSERT(*test_map_get(&m, &keys[i]) == i);
+    }
+
+    bool inserted;
+    struct test_map_entry *entry = test_map_entry(&m, &keys[1], &inserted);
+    ASSERT(!inserted);
+    entry->value = 42;
+    ASSERT(*test_map_get(&m, &keys[1]) == 42);
+    ASSERT(test_map_len(&m) == n);
+
+    test_map_free(&m);
+    free(keys);
+}
+
+SMALL_MAP_DEFINE(test_small_map, const char *, size_t, 4, map_hash_ptr,
+                 map_eq_ptr)
+
+// Few entries are kept inline, and more move to a hash map.
+TEST(small_map) {
+    char keys[100];
+
+    struct test_small_map m = {0};
+    ASSERT(test_small_map_len(&m) == 0);
+    ASSERT(test_small_map_get(&m, &keys[0]) == NULL);
+
+    for (size_t i = 0; i < 4; i++) {
+        test_small_map_insert(&m, &keys[i], i);
+    }
+    test_small_map_insert(&m, &keys[1], 42);
+    ASSERT(!m.large);
+    ASSERT(test_small_map_len(&m) == 4);
+    ASSERT(*test_small_map_get(&m, &keys[1]) == 42);
+    ASSERT(test_small_map_get(&m, &keys[4]) == NULL);
+
+    for (size_t i = 4; i < 100; i++) {
+        test_small_map_insert(&m, &keys[i], i);
+    }
+    ASSERT(m.large);
+    ASSERT(test_small_map_len(&m) == 100);
+    for (size_t i = 0; i < 100; i++) {
+        ASSERT(*test_small_map_get(&m, &keys[i]) == (i == 1 ? 42 : i));
+    }
+
+    test_small_map_free(&m);
+    ASSERT(!m.large);
+    ASSERT(test_small_map_len(&m) == 0);
+}
+
+VEC_DEFINE(test_vec, uint32_t)
+
+TEST(typed_vec) {
+    struct test_vec v = {0};
+    for (uint32_t i = 0; i < 1000; i++) {
+        ASSERT(test_vec_push(&v, i * 3) == i);
+    }
+    ASSERT(test_vec_len(&v) == 1000);
+    ASSERT(*test_vec_get(&v, 999) == 2997);
+
+    uint32_t *raw;
+    ASSERT(test_vec_into_raw(&v, &raw) == 1000);
+    ASSERT(raw[500] == 1500);
+    ASSERT(test_vec_len(&v) == 0);
+
+    free(raw);
+}
+
+// The string hash reads whole words, so check every length up to and past a
+// few words: only the bytes in the string may affect it.
+TEST(hash_lengths) {
+    char a[80], b[80];
+    memset(a, 'x', sizeof(a));
+    memset(b, 'y', sizeof(b));
+
+    uint32_t previous = 0;
+    for (size_t len = 0; len < 64; len++) {
+        for (size_t i = 0; i < len; i++) {
+            a[i + 8] = b[i + 3] = 'a' + i % 26;
+        }
+        uint32_t hash = map_hash_bytes(a + 8, len);
+        ASSERT(hash == map_hash_bytes(b + 3, len));
+        ASSERT(hash == map_hash_string(a + 8, len));
+        ASSERT(len == 0 || hash != previous);
+        previous = hash;
+    }
+}
+
+TEST(stats) {
+    size_t n = 10000;
+    char *keys = malloc(n);
+
+    struct map *m = map_new(map_key_pointer);
+    for (size_t i = 0; i < n; i++) {
+        map_insert(m, &keys[i], &keys[i]);
+    }
+
+    struct map_stats stats = map_stats(m);
+    ASSERT(stats.count == n);
+    ASSERT(stats.capacity >= n);
+    ASSERT(stats.mean_probe >= 1 && stats.mean_probe < 1.5);
+    ASSERT(stats.max_probe >= 1);
+
+    map_free(m);
+    free(keys);
+}
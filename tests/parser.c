@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ast.h"
 #include "parser.h"
@@ -6,7 +8,10 @@
 #include "common.h"
 #include "framework.h"
 #include "ident.h"
+#include "map.h"
+#include "pprint.h"
 #include "snapshot.h"
+#include "tokens.h"
 
 static void parser_snapshotter(FILE *f, void *data) {
     const char *prog = (const char *)data;
@@ -14,15 +19,20 @@ static void parser_snapshotter(FILE *f, void *data) {
     struct ident_table *idents = ident_table_new();
 
     ast_program_t program;
-    parse_result_t result = parser_parse(idents, prog, &program);
+    parse_result_t result = parser_parse(idents, prog, strlen(prog), &program);
     if (result.kind == Parse_Result_Error) {
-        diag_print(prog, &result.diag);
+        struct lines *lines = lines_new(prog, strlen(prog));
+        diag_print(prog, strlen(prog), lines, &result.diag);
+        lines_free(lines);
         FAIL("FAILED TO PARSE", "");
     }
 
     struct pprint *pp = pprint_new(f);
     ast_pprint_program(pp, &program);
     pprint_free(pp);
+
+    ast_program_free(&program);
+    ident_table_free(idents);
 }
 
 #define PARSER_TEST(name, prog)                                                \
@@ -108,6 +118,11 @@ PARSER_TEST(assignops, "int main() {\n"
                        "e /= 4;\n"
                        "}")
 
+// Assignment is right-associative, and binds looser than everything else.
+PARSER_TEST(assignops_associativity, "int main() {\n"
+                                     "a = b += c == d;\n"
+                                     "}")
+
 PARSER_TEST(expr_variables, "int main() {\n"
                             "int a = a + b;\n"
                             "}")
@@ -124,8 +139,569 @@ PARSER_TEST(stmt_if, "int main() {\n"
                      "}\n"
                      "}")
 
+// An else belongs to the nearest if.
+PARSER_TEST(stmt_if_nested, "int main() {\n"
+                            "if (a) if (b) c; else d;\n"
+                            "if (a) { if (b) c; }\n"
+                            "else if (d) { { e; } }\n"
+                            "else f;\n"
+                            "}")
+
 PARSER_TEST(multiple_functions, "int main() {}\n"
                                 "int other() {}\n")
 
 // TODO: "void no_return_type() {}\n"
 // TODO: "int arguments(int i) {}\n"
+
+// Machine-generated code can be far more deeply nested than anything written
+// by hand.
+
+#define DEEP 1000000
+
+// prefix, then n copies of unit, then suffix.
+static char *repeat(const char *prefix, const char *unit, size_t n,
+                    const char *suffix) {
+    size_t prefix_len = strlen(prefix), unit_len = strlen(unit);
+    char *prog = malloc(prefix_len + unit_len * n + strlen(suffix) + 1);
+
+    char *p = prog;
+    memcpy(p, prefix, prefix_len);
+    p += prefix_len;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(p, unit, unit_len);
+        p += unit_len;
+    }
+    strcpy(p, suffix);
+
+    return prog;
+}
+
+static parse_result_t parse_with_depth(const char *prog, size_t max_depth,
+                                       ast_program_t *program) {
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, strlen(prog));
+    struct parser_options opts = {.max_depth = max_depth};
+    parse_result_t result =
+        parser_parse_tokens(idents, prog, tokens, &opts, program);
+    tokens_free(tokens);
+    ident_table_free(idents);
+    return result;
+}
+
+// Left-associative operators never need to wait on their right operands, so
+// chains of them aren't limited.
+TEST(parse_deep_expr) {
+    char *prog = repeat("int main() { return 1", " + 2 * 3", DEEP, "; }");
+
+    struct ident_table *idents = ident_table_new();
+    ast_program_t program;
+    parse_result_t result =
+        parser_parse(idents, prog, strlen(prog), &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+    ASSERT(program.ordered[0]->nodes.nexprs == 4 * DEEP + 1);
+
+    // Printing the tree doesn't recurse as deeply as it goes, either.
+    FILE *out = fopen("/dev/null", "w");
+    struct pprint *pp = pprint_new(out);
+    ast_pprint_program(pp, &program);
+    pprint_free(pp);
+    fclose(out);
+
+    ast_program_free(&program);
+    ident_table_free(idents);
+    free(prog);
+}
+
+TEST(parse_deep_assignment) {
+    char *prog = repeat("int main() { a", " = a", DEEP, "; }");
+
+    ast_program_t program;
+    parse_result_t result = parse_with_depth(prog, 0, &program);
+    ASSERT(result.kind == Parse_Result_Error);
+    ASSERT(strcmp(result.diag.msg, "expression nested too deeply") == 0);
+
+    result = parse_with_depth(prog, DEEP, &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+    ASSERT(program.ordered[0]->nodes.nexprs == 2 * DEEP + 1);
+    ast_program_free(&program);
+
+    free(prog);
+}
+
+TEST(parse_deep_if) {
+    char *prog = repeat("int main() { ", "if (1) ", DEEP, "return 0; }");
+
+    ast_program_t program;
+    parse_result_t result = parse_with_depth(prog, 0, &program);
+    ASSERT(result.kind == Parse_Result_Error);
+    ASSERT(strcmp(result.diag.msg, "statement nested too deeply") == 0);
+
+    // The function's block takes a frame too.
+    result = parse_with_depth(prog, DEEP + 1, &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+    ASSERT(program.ordered[0]->nodes.nstmts == DEEP + 1);
+    ast_program_free(&program);
+
+    free(prog);
+}
+
+TEST(parse_deep_blocks) {
+    char *open = repeat("int main() ", "{", DEEP, "");
+    char *prog = repeat(open, "}", DEEP, "");
+
+    ast_program_t program;
+    parse_result_t result = parse_with_depth(prog, 0, &program);
+    ASSERT(result.kind == Parse_Result_Error);
+
+    result = parse_with_depth(prog, DEEP, &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+    ASSERT(program.ordered[0]->nodes.nblocks == DEEP - 1);
+    ast_program_free(&program);
+
+    free(open);
+    free(prog);
+}
+
+static char *pprint_to_string(ast_program_t *program) {
+    char *str = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&str, &len);
+    struct pprint *pp = pprint_new(f);
+    ast_pprint_program(pp, program);
+    pprint_free(pp);
+    fclose(f);
+    return str;
+}
+
+// Skipped bodies parse to the same thing as they would have up front.
+TEST(lazy_bodies) {
+    const char *prog = "int a() { if (x) { y = 1; } else { { z; } } }\n"
+                       "int b() { int i = 0; return i + 1; }\n"
+                       "int c() {}\n";
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, strlen(prog));
+
+    ast_program_t eager;
+    parse_result_t result =
+        parser_parse_tokens(idents, prog, tokens, NULL, &eager);
+    ASSERT(result.kind == Parse_Result_Ok);
+
+    struct parser_options opts = {.lazy_bodies = true};
+    ast_program_t lazy;
+    result = parser_parse_tokens(idents, prog, tokens, &opts, &lazy);
+    ASSERT(result.kind == Parse_Result_Ok);
+    ASSERT(lazy.nfunctions == 3);
+    for (size_t i = 0; i < lazy.nfunctions; i++) {
+        ASSERT(lazy.ordered[i]->body == Ast_Body_Unparsed);
+        ASSERT(lazy.ordered[i]->body_begin == eager.ordered[i]->body_begin);
+        ASSERT(lazy.ordered[i]->body_end == eager.ordered[i]->body_end);
+    }
+
+    ASSERT(parser_parse_body(&lazy, lazy.ordered[1]).kind == Parse_Result_Ok);
+    ASSERT(lazy.ordered[1]->body == Ast_Body_Parsed);
+    ASSERT(lazy.ordered[0]->body == Ast_Body_Unparsed);
+
+    ASSERT(parser_parse_bodies(&lazy).kind == Parse_Result_Ok);
+    char *expected = pprint_to_string(&eager);
+    char *actual = pprint_to_string(&lazy);
+    ASSERT(strcmp(expected, actual) == 0);
+
+    free(expected);
+    free(actual);
+    ast_program_free(&eager);
+    ast_program_free(&lazy);
+    tokens_free(tokens);
+    ident_table_free(idents);
+}
+
+// Errors within a skipped body are only found once it's parsed, but
+// unbalanced braces are found up front.
+TEST(lazy_bodies_error) {
+    const char *prog = "int a() { return; }";
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, strlen(prog));
+    struct parser_options opts = {.lazy_bodies = true};
+
+    ast_program_t program;
+    parse_result_t result =
+        parser_parse_tokens(idents, prog, tokens, &opts, &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+
+    result = parser_parse_body(&program, program.ordered[0]);
+    ASSERT(result.kind == Parse_Result_Error);
+    ASSERT(strcmp(result.diag.msg, "expected primary expression") == 0);
+    ast_program_free(&program);
+
+    // The error is kept, and reported once however often it's asked for.
+    struct diags diags = {0};
+    opts.diags = &diags;
+    result = parser_parse_tokens(idents, prog, tokens, &opts, &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+    for (size_t i = 0; i < 3; i++) {
+        result = parser_parse_body(&program, program.ordered[0]);
+        ASSERT(result.kind == Parse_Result_Error);
+        ASSERT(strcmp(result.diag.msg, "expected primary expression") == 0);
+        ASSERT(program.ordered[0]->body == Ast_Body_Failed);
+        result = parser_parse_bodies(&program);
+        ASSERT(result.kind == Parse_Result_Error);
+    }
+    ASSERT(diags.len == 1);
+    diags_free(&diags);
+    opts.diags = NULL;
+    ast_program_free(&program);
+    tokens_free(tokens);
+
+    prog = "int a() { { }";
+    tokens = tokens_lex(idents, prog, strlen(prog));
+    result = parser_parse_tokens(idents, prog, tokens, &opts, &program);
+    ASSERT(result.kind == Parse_Result_Error);
+    ASSERT(strcmp(result.diag.msg, "expected closing brace") == 0);
+    tokens_free(tokens);
+
+    ident_table_free(idents);
+}
+
+// Enough functions to be parsed in parallel. If error_at isn't SIZE_MAX, the
+// functions from there on have an error.
+static char *many_functions(size_t error_at, size_t *len) {
+    char *prog = NULL;
+    *len = 0;
+    FILE *f = open_memstream(&prog, len);
+    for (size_t i = 0; i < 4000; i++) {
+        fprintf(f, "int f%zu() {\n", i);
+        fprintf(f, "    int a = %zu;\n", i);
+        fprintf(f, "    if (a == 1) { a += a * 2; } else { return a; }\n");
+        fprintf(f, "    return a%s;\n", i >= error_at ? " +" : "");
+        fprintf(f, "}\n");
+    }
+    fclose(f);
+    return prog;
+}
+
+static parse_result_t parse_jobs(struct ident_table *idents, const char *prog,
+                                 size_t len, size_t jobs,
+                                 ast_program_t *program) {
+    struct tokens *tokens = tokens_lex(idents, prog, len);
+    struct parser_options opts = {.jobs = jobs};
+    parse_result_t result =
+        parser_parse_tokens(idents, prog, tokens, &opts, program);
+    tokens_free(tokens);
+    return result;
+}
+
+TEST(parallel_bodies) {
+    size_t len;
+    char *prog = many_functions(SIZE_MAX, &len);
+    struct ident_table *idents = ident_table_new();
+
+    ast_program_t serial, parallel;
+    ASSERT(parse_jobs(idents, prog, len, 1, &serial).kind == Parse_Result_Ok);
+    ASSERT(parse_jobs(idents, prog, len, 4, &parallel).kind ==
+           Parse_Result_Ok);
+
+    ASSERT(parallel.nfunctions == 4000);
+    for (size_t i = 0; i < parallel.nfunctions; i++) {
+        ASSERT(parallel.ordered[i]->body == Ast_Body_Parsed);
+        ASSERT(map_get(parallel.functions,
+                       ident_to_str(parallel.ordered[i]->ident)) ==
+               parallel.ordered[i]);
+    }
+
+    char *expected = pprint_to_string(&serial);
+    char *actual = pprint_to_string(&parallel);
+    ASSERT(strcmp(expected, actual) == 0);
+
+    free(expected);
+    free(actual);
+    ast_program_free(&serial);
+    ast_program_free(&parallel);
+    ident_table_free(idents);
+    free(prog);
+}
+
+// The error reported is the first in the source, whichever thread finds it.
+TEST(parallel_bodies_error) {
+    size_t len;
+    char *prog = many_functions(3000, &len);
+    struct ident_table *idents = ident_table_new();
+
+    ast_program_t program;
+    parse_result_t serial = parse_jobs(idents, prog, len, 1, &program);
+    ASSERT(serial.kind == Parse_Result_Error);
+    for (size_t i = 0; i < 10; i++) {
+        parse_result_t parallel = parse_jobs(idents, prog, len, 4, &program);
+        ASSERT(parallel.kind == Parse_Result_Error);
+        ASSERT(parallel.diag.span.offset == serial.diag.span.offset);
+        ASSERT(strcmp(parallel.diag.msg, serial.diag.msg) == 0);
+    }
+
+    ident_table_free(idents);
+    free(prog);
+}
+
+static parse_result_t parse_recovering(struct ident_table *idents,
+                                       const char *prog, size_t len,
+                                       size_t jobs, struct diags *diags) {
+    struct tokens *tokens = tokens_lex(idents, prog, len);
+    struct parser_options opts = {.jobs = jobs, .diags = diags};
+    ast_program_t program;
+    parse_result_t result =
+        parser_parse_tokens(idents, prog, tokens, &opts, &program);
+    tokens_free(tokens);
+    return result;
+}
+
+// Each error is reported, in order, and the first is the result.
+TEST(recover_errors) {
+    const char *prog = "int a() {\n"
+                       "    int x = ;\n"
+                       "    if (x { return 1; } else { x = 2; }\n"
+                       "    x = 2\n"
+                       "    x = @ 3;\n"
+                       "    return x +;\n"
+                       "}\n"
+                       "int b( {}\n"
+                       "int c() { return 1; }\n";
+    // Where each error is, and what it says.
+    const char *expected[][2] = {
+        {";\n    if", "expected primary expression"},
+        {"{ return 1", "expected closing parenthesis"},
+        {"x = @", "expected semicolon"},
+        {"@", "unexpected character"},
+        {";\n}", "expected primary expression"},
+        {"{}", "expected closing parenthesis"},
+    };
+    size_t nexpected = sizeof(expected) / sizeof(expected[0]);
+
+    struct ident_table *idents = ident_table_new();
+    struct diags diags = {0};
+    parse_result_t result =
+        parse_recovering(idents, prog, strlen(prog), 1, &diags);
+
+    ASSERT(result.kind == Parse_Result_Error);
+    ASSERT(diags.len == nexpected);
+    ASSERT(!diags.truncated);
+    ASSERT(result.diag.span.offset == diags.list[0].span.offset);
+    for (size_t i = 0; i < nexpected; i++) {
+        size_t offset = strstr(prog, expected[i][0]) - prog;
+        ASSERT(diags.list[i].span.offset == offset);
+        ASSERT(strcmp(diags.list[i].msg, expected[i][1]) == 0);
+    }
+
+    diags_free(&diags);
+    ident_table_free(idents);
+}
+
+// Past the limit, errors are dropped and the parser gives up.
+TEST(recover_limit) {
+    const char *prog = repeat("int a() {\n", "    return +;\n", 100, "}\n");
+    struct ident_table *idents = ident_table_new();
+    struct diags diags = {.max = 10};
+    parse_result_t result =
+        parse_recovering(idents, prog, strlen(prog), 1, &diags);
+
+    ASSERT(result.kind == Parse_Result_Error);
+    ASSERT(diags.len == 10);
+    ASSERT(diags.truncated);
+
+    diags_free(&diags);
+    ident_table_free(idents);
+    free((char *)prog);
+}
+
+// Bodies parsed in parallel report the same errors as when parsed serially,
+// even when there are too many to keep.
+TEST(recover_parallel) {
+    size_t len;
+    char *prog = many_functions(3000, &len);
+    struct ident_table *idents = ident_table_new();
+
+    struct diags serial = {0}, parallel = {0};
+    parse_recovering(idents, prog, len, 1, &serial);
+    parse_recovering(idents, prog, len, 4, &parallel);
+
+    ASSERT(serial.len == DIAGS_MAX);
+    ASSERT(serial.truncated);
+    ASSERT(parallel.len == serial.len);
+    ASSERT(parallel.truncated);
+    for (size_t i = 0; i < serial.len; i++) {
+        ASSERT(parallel.list[i].span.offset == serial.list[i].span.offset);
+        ASSERT(strcmp(parallel.list[i].msg, serial.list[i].msg) == 0);
+    }
+
+    diags_free(&serial);
+    diags_free(&parallel);
+    ident_table_free(idents);
+    free(prog);
+}
+
+// Replaces the first occurrence of from in prog with to, applying the same
+// edit to program, and checks that the result is the same as parsing the
+// edited source from scratch. Returns the edited source.
+static char *reparse(struct ident_table *idents, const char *prog,
+                     const char *from, const char *to,
+                     ast_program_t *program, parse_result_t *result) {
+    struct parser_edit edit = {
+        .offset = strstr(prog, from) - prog,
+        .len = strlen(from),
+        .text = to,
+        .text_len = strlen(to),
+    };
+    size_t len = strlen(prog) - edit.len + edit.text_len;
+    char *edited = malloc(len + 1);
+    memcpy(edited, prog, edit.offset);
+    strcpy(edited + edit.offset, to);
+    strcat(edited, prog + edit.offset + edit.len);
+
+    *result = parser_reparse(idents, prog, strlen(prog), edit, NULL, program);
+
+    ast_program_t expected;
+    parse_result_t expected_result =
+        parser_parse(idents, edited, len, &expected);
+    ASSERT(result->kind == expected_result.kind);
+    if (result->kind == Parse_Result_Error) {
+        ASSERT(result->diag.span.offset == expected_result.diag.span.offset);
+        ASSERT(strcmp(result->diag.msg, expected_result.diag.msg) == 0);
+        return edited;
+    }
+
+    // The functions which haven't been moved yet are behind by the same
+    // amount.
+    ASSERT(program->nfunctions == expected.nfunctions);
+    for (size_t i = 0; i < expected.nfunctions; i++) {
+        uint32_t shift = i >= program->shifted ? program->shift : 0;
+        ASSERT(program->ordered[i]->begin + shift ==
+               expected.ordered[i]->begin);
+        ASSERT(program->ordered[i]->end + shift == expected.ordered[i]->end);
+    }
+    char *actual_str = pprint_to_string(program);
+    char *expected_str = pprint_to_string(&expected);
+    ASSERT(strcmp(actual_str, expected_str) == 0);
+    free(actual_str);
+    free(expected_str);
+    ast_program_free(&expected);
+
+    return edited;
+}
+
+static const char reparse_prog[] = "int a() { return 1; }\n"
+                                   "int b() {\n"
+                                   "    int x = 2;\n"
+                                   "    return x;\n"
+                                   "}\n"
+                                   "/* c */ int c() { return 3; }\n";
+
+// An edit within a function only replaces that function.
+TEST(reparse_function) {
+    struct ident_table *idents = ident_table_new();
+    ast_program_t program;
+    ASSERT(parser_parse(idents, reparse_prog, strlen(reparse_prog), &program)
+               .kind == Parse_Result_Ok);
+    ast_function_t *a = program.ordered[0], *b = program.ordered[1],
+                   *c = program.ordered[2];
+
+    parse_result_t result;
+    char *prog = reparse(idents, reparse_prog, "x = 2;",
+                         "x = 22 + 4;\n    int y = x;", &program, &result);
+    ASSERT(result.kind == Parse_Result_Ok);
+    ASSERT(program.ordered[0] == a);
+    ASSERT(program.ordered[1] != b);
+    ASSERT(program.ordered[2] == c);
+
+    // Edits build on each other, and the source they were made to needn't
+    // outlive them. The source the program was first parsed from does.
+    char *edited = reparse(idents, prog, "return x", "return x * y",
+                           &program, &result);
+    ASSERT(result.kind == Parse_Result_Ok);
+    free(prog);
+    prog = reparse(idents, edited, "int b", "int bee", &program, &result);
+    ASSERT(program.ordered[0] == a);
+    ASSERT(program.ordered[2] == c);
+    ASSERT(map_get(program.functions, "bee") == program.ordered[1]);
+    ASSERT(map_get(program.functions, "b") == NULL);
+
+    // Back and forth, so that functions need moving both ways.
+    free(edited);
+    edited = reparse(idents, prog, "return 3", "return 3 + 3 + 3", &program,
+                     &result);
+    free(prog);
+    prog = reparse(idents, edited, "return 1", "return 0", &program, &result);
+    free(edited);
+    edited = reparse(idents, prog, "int y = x;", "", &program, &result);
+    ASSERT(result.kind == Parse_Result_Ok);
+    ASSERT(program.ordered[0] != a);
+    ASSERT(program.ordered[2] != c);
+
+    parser_update_offsets(&program);
+    ASSERT(program.ordered[2]->begin == strstr(edited, "int c") - edited);
+    ASSERT(program.ordered[2]->end == strlen(edited) - 1);
+
+    free(edited);
+    free(prog);
+    ast_program_free(&program);
+    ident_table_free(idents);
+}
+
+// Edits which don't fall within the source are an error, which leaves the
+// program as it was.
+TEST(reparse_out_of_range) {
+    static const struct parser_edit edits[] = {
+        {.offset = sizeof(reparse_prog), .len = 0, .text = "x", .text_len = 1},
+        {.offset = sizeof(reparse_prog) - 2, .len = 2},
+        {.offset = 1, .len = SIZE_MAX},
+    };
+
+    struct ident_table *idents = ident_table_new();
+    ast_program_t program;
+    ASSERT(parser_parse(idents, reparse_prog, strlen(reparse_prog), &program)
+               .kind == Parse_Result_Ok);
+    char *before = pprint_to_string(&program);
+
+    for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); i++) {
+        parse_result_t result = parser_reparse(
+            idents, reparse_prog, strlen(reparse_prog), edits[i], NULL,
+            &program);
+        ASSERT(result.kind == Parse_Result_Error);
+        ASSERT(strcmp(result.diag.msg, "edit is outside the source") == 0);
+    }
+
+    char *after = pprint_to_string(&program);
+    ASSERT(strcmp(before, after) == 0);
+    free(before);
+    free(after);
+    ast_program_free(&program);
+    ident_table_free(idents);
+}
+
+// Edits which change more than one function are parsed again in full, as
+// are those which leave an error.
+TEST(reparse_program) {
+    static const char *edits[][2] = {
+        // Between functions:
+        {"/* c */", "int d() { return 4; }"},
+        // Splitting a function in two:
+        {"    int x = 2;\n", "}\nint d() {\n"},
+        // Joining two:
+        {"}\n/* c */ int c() {", ""},
+        // Leaving an error:
+        {"return x", "return x +"},
+        // An unterminated comment, which only ends in the next function:
+        {"return x;", "/*"},
+    };
+
+    struct ident_table *idents = ident_table_new();
+    for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); i++) {
+        ast_program_t program;
+        ASSERT(parser_parse(idents, reparse_prog, strlen(reparse_prog),
+                            &program)
+                   .kind == Parse_Result_Ok);
+
+        parse_result_t result;
+        free(reparse(idents, reparse_prog, edits[i][0], edits[i][1], &program,
+                     &result));
+        if (result.kind == Parse_Result_Ok) {
+            ast_program_free(&program);
+        }
+    }
+    ident_table_free(idents);
+}
@@ -0,0 +1,92 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+
+#include "framework.h"
+
+#define INPUT_LEN 1024
+#define ROUNDS 200
+
+static const struct scan_kernels *kernels[] = {
+    &scan_kernels_scalar,
+#if defined(SCAN_X86)
+    &scan_kernels_sse2,
+    &scan_kernels_avx2,
+#endif
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static bool supported(const struct scan_kernels *k) {
+#if defined(SCAN_X86)
+    if (k == &scan_kernels_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void)k;
+    return true;
+}
+
+// Random input with long runs of each class of byte, so that runs cross
+// block boundaries and finish in the tail.
+static void fill(char *buf, size_t len, uint32_t *seed) {
+    static const char *alphabets[] = {" \t\n", "abcXYZ_019", "0123456789",
+                                      "*/\n x", "!\x80;("};
+    size_t i = 0;
+    while (i < len) {
+        *seed = *seed * 1103515245 + 12345;
+        const char *alphabet = alphabets[(*seed >> 16) % 5];
+        size_t run = 1 + (*seed >> 8) % 70;
+        for (size_t j = 0; j < run && i < len; j++, i++) {
+            *seed = *seed * 1103515245 + 12345;
+            buf[i] = alphabet[(*seed >> 16) % strlen(alphabet)];
+        }
+    }
+}
+
+// Every kernel must agree with the scalar one, from every starting offset.
+TEST(kernels_agree) {
+    char *buf = malloc(INPUT_LEN);
+    uint32_t seed = 1;
+
+    for (size_t round = 0; round < ROUNDS; round++) {
+        fill(buf, INPUT_LEN, &seed);
+        const char *end = buf + INPUT_LEN - round % 40;
+
+        for (const char *p = buf; p <= end; p++) {
+            const struct scan_kernels *s = &scan_kernels_scalar;
+
+            for (size_t k = 1; k < NUM_KERNELS; k++) {
+                if (!supported(kernels[k])) {
+                    continue;
+                }
+
+                ASSERT(kernels[k]->whitespace(p, end) ==
+                       s->whitespace(p, end));
+                ASSERT(kernels[k]->comment_end(p, end) ==
+                       s->comment_end(p, end));
+                ASSERT(kernels[k]->ident(p, end) == s->ident(p, end));
+                ASSERT(kernels[k]->digits(p, end) == s->digits(p, end));
+                ASSERT(kernels[k]->newline(p, end) == s->newline(p, end));
+            }
+        }
+    }
+
+    free(buf);
+}
+
+TEST(comment_end) {
+    const char *prog = "a\n*\n/ * / */ b";
+    const char *end = prog + strlen(prog);
+
+    for (size_t k = 0; k < NUM_KERNELS; k++) {
+        if (!supported(kernels[k])) {
+            continue;
+        }
+        ASSERT(kernels[k]->comment_end(prog, end) == prog + 10);
+    }
+}
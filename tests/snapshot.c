@@ -88,13 +88,16 @@ void snapshot_test(const char *file, const char *name,
     char *path_old = snapshot_path(file, name);
     char *path_new = snapshot_path_new(path_old);
 
-    char *directory = dirname(path_old);
+    // dirname() may modify its argument, as glibc's does.
+    char *copy = strdup(path_old);
+    char *directory = dirname(copy);
     if (directory == NULL) {
         HANDLE_ERROR("dirname");
     }
     if (ensure_directory(directory)) {
         HANDLE_ERROR("ensure_directory");
     }
+    free(copy);
 
     ensure_snapshot(path_old);
 
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ident.h"
+#include "symtab_define.h"
+
+#include "framework.h"
+
+SYMTAB_DEFINE(int_table, int)
+
+TEST(symtab_shadowing) {
+    struct ident_table *idents = ident_table_new();
+    struct ident *a = ident_from_str(idents, "a");
+    struct ident *b = ident_from_str(idents, "b");
+
+    struct int_table t = {0};
+    ASSERT(int_table_get(&t, a) == NULL);
+
+    int_table_declare(&t, a, 1);
+    int_table_enter(&t);
+    ASSERT(*int_table_get(&t, a) == 1);
+    ASSERT(int_table_get_local(&t, a) == NULL);
+
+    int_table_declare(&t, a, 2);
+    int_table_declare(&t, b, 3);
+    ASSERT(*int_table_get(&t, a) == 2);
+    ASSERT(*int_table_get_local(&t, a) == 2);
+    ASSERT(*int_table_get(&t, b) == 3);
+
+    // Declaring again in the same scope shadows too, until it's left.
+    int_table_declare(&t, a, 4);
+    ASSERT(*int_table_get(&t, a) == 4);
+
+    int_table_leave(&t);
+    ASSERT(*int_table_get(&t, a) == 1);
+    ASSERT(*int_table_get_local(&t, a) == 1);
+    ASSERT(int_table_get(&t, b) == NULL);
+
+    int_table_free(&t);
+    ident_table_free(idents);
+}
+
+// Lookups don't depend on how deeply scopes nest, and leaving them all
+// uncovers the outermost binding of each name.
+TEST(symtab_deep) {
+    struct ident_table *idents = ident_table_new();
+    struct ident *names[100];
+    for (size_t i = 0; i < 100; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "v%zu", i);
+        names[i] = ident_from_str(idents, name);
+    }
+
+    struct int_table t = {0};
+    for (int depth = 0; depth < 100000; depth++) {
+        int_table_enter(&t);
+        int_table_declare(&t, names[depth % 100], depth);
+        ASSERT(*int_table_get(&t, names[depth % 100]) == depth);
+    }
+    for (int depth = 100000; depth > 100; depth--) {
+        int_table_leave(&t);
+    }
+    for (size_t i = 0; i < 100; i++) {
+        ASSERT(*int_table_get(&t, names[i]) == (int)i);
+    }
+    for (size_t i = 0; i < 100; i++) {
+        int_table_leave(&t);
+    }
+    ASSERT(t.bindings.len == 0);
+    ASSERT(int_table_get(&t, names[0]) == NULL);
+
+    int_table_free(&t);
+    ident_table_free(idents);
+}
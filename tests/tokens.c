@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ident.h"
+#include "lexer.h"
+#include "tokens.h"
+
+#include "framework.h"
+
+TEST(buffer) {
+    const char *prog = "int x = 12;";
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, strlen(prog));
+
+    ASSERT(tokens->len == 5);
+    ASSERT(tokens->lexed == strlen(prog));
+
+    ASSERT(tokens->kinds[0] == Token_Keyword);
+    ASSERT(tokens->payloads[0] == Keyword_int);
+
+    ASSERT(tokens->kinds[1] == Token_Identifier);
+    ASSERT(ident_table_get(idents, tokens->payloads[1]) ==
+           ident_from_str(idents, "x"));
+
+    ASSERT(tokens->kinds[3] == Token_Constant);
+    ASSERT(tokens->offsets[3] == 8);
+    ASSERT(tokens->lens[3] == 2);
+
+    ASSERT(tokens->kinds[4] == Token_Punctuator);
+    ASSERT(tokens->payloads[4] == Punctuator_Semicolon);
+
+    // Terminated by Token_Eof, at the end of the input:
+    ASSERT(tokens->kinds[5] == Token_Eof);
+    ASSERT(tokens->offsets[5] == strlen(prog));
+
+    token_t token = tokens_get(tokens, idents, 1);
+    ASSERT(token.discrim == Token_Identifier);
+    ASSERT(strcmp(ident_to_str(token.ident), "x") == 0);
+    ASSERT(token.span.offset == 4 && token.span.len == 1);
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+}
+
+TEST(empty_buffer) {
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, "", 0);
+
+    ASSERT(tokens->len == 0);
+    ASSERT(tokens->kinds[0] == Token_Eof);
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+}
+
+// Characters which can't be lexed are reported and skipped.
+TEST(lex_error) {
+    const char *prog = "a @ b $";
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, strlen(prog));
+
+    ASSERT(tokens->len == 2);
+    ASSERT(tokens->lexed == strlen(prog));
+    ASSERT(tokens->kinds[1] == Token_Identifier);
+    ASSERT(tokens->offsets[1] == 4);
+    ASSERT(tokens->kinds[2] == Token_Eof);
+
+    ASSERT(tokens->diags.len == 2);
+    ASSERT(tokens->diags.list[0].span.offset == 2);
+    ASSERT(tokens->diags.list[0].span.len == 1);
+    ASSERT(strcmp(tokens->diags.list[0].msg, "unexpected character") == 0);
+    ASSERT(tokens->diags.list[1].span.offset == 6);
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+}
+
+// An unterminated comment runs to the end, so lexing stops there.
+TEST(lex_error_comment) {
+    const char *prog = "a /* b";
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, strlen(prog));
+
+    ASSERT(tokens->len == 1);
+    ASSERT(tokens->lexed == 2);
+    ASSERT(tokens->diags.len == 1);
+    ASSERT(strcmp(tokens->diags.list[0].msg, "unterminated comment") == 0);
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+}
+
+// Only so many errors are reported, and then lexing stops.
+TEST(lex_error_limit) {
+    char prog[DIAGS_MAX * 4];
+    for (size_t i = 0; i < sizeof(prog); i++) {
+        prog[i] = i % 2 == 0 ? '@' : ' ';
+    }
+    struct ident_table *idents = ident_table_new();
+    struct tokens *tokens = tokens_lex(idents, prog, sizeof(prog));
+
+    ASSERT(tokens->diags.len == DIAGS_MAX);
+    ASSERT(tokens->diags.truncated);
+    ASSERT(tokens->lexed == DIAGS_MAX * 2);
+
+    tokens_free(tokens);
+    ident_table_free(idents);
+}
+
+// A large input, with block comments that span the boundaries between the
+// parallel lexer's chunks.
+static char *large_input(size_t *len) {
+    char *prog = NULL;
+    *len = 0;
+    FILE *f = open_memstream(&prog, len);
+    for (size_t i = 0; *len < 512 * 1024; i++) {
+        fprintf(f, "int f%zu(int x) { return x * %zu; }\n", i % 1000, i);
+        if (i % 3 == 0) {
+            fprintf(f, "/* comment /* %zu\n\nx = y; //\n */\n", i);
+        }
+        // Longer than a chunk, so at least one chunk starts inside it.
+        if (i == 1000) {
+            fprintf(f, "/*\n");
+            for (size_t j = 0; j < 8000; j++) {
+                fprintf(f, "x = y; // z\n");
+            }
+            fprintf(f, "*/\n");
+        }
+        fflush(f);
+    }
+    fclose(f);
+    return prog;
+}
+
+TEST(parallel) {
+    size_t len;
+    char *prog = large_input(&len);
+
+    struct ident_table *serial_idents = ident_table_new();
+    struct tokens *serial = tokens_lex(serial_idents, prog, len);
+    struct ident_table *parallel_idents = ident_table_new();
+    struct tokens *parallel =
+        tokens_lex_parallel(parallel_idents, prog, len, 8);
+
+    ASSERT(parallel->len == serial->len);
+    ASSERT(parallel->lexed == len);
+    ASSERT(parallel->diags.len == 0);
+    for (size_t i = 0; i <= serial->len; i++) {
+        ASSERT(parallel->kinds[i] == serial->kinds[i]);
+        ASSERT(parallel->offsets[i] == serial->offsets[i]);
+        ASSERT(parallel->lens[i] == serial->lens[i]);
+
+        if (serial->kinds[i] == Token_Identifier) {
+            struct ident *a =
+                ident_table_get(serial_idents, serial->payloads[i]);
+            struct ident *b =
+                ident_table_get(parallel_idents, parallel->payloads[i]);
+            ASSERT(strcmp(ident_to_str(a), ident_to_str(b)) == 0);
+        } else {
+            ASSERT(parallel->payloads[i] == serial->payloads[i]);
+        }
+    }
+
+    // Words from inside the comments aren't interned.
+    ASSERT(ident_table_len(parallel_idents) ==
+           ident_table_len(serial_idents));
+
+    tokens_free(parallel);
+    ident_table_free(parallel_idents);
+    tokens_free(serial);
+    ident_table_free(serial_idents);
+    free(prog);
+}
+
+// Errors in the middle of a large input are reported and skipped by the
+// parallel lexer just as by the serial one.
+TEST(parallel_error) {
+    size_t len;
+    char *prog = large_input(&len);
+    *strstr(prog + len / 3, "return") = '@';
+    *strstr(prog + len / 2, "return") = '$';
+
+    struct ident_table *idents = ident_table_new();
+    struct tokens *serial = tokens_lex(idents, prog, len);
+    struct tokens *parallel = tokens_lex_parallel(idents, prog, len, 4);
+
+    ASSERT(serial->diags.len == 2);
+    ASSERT(parallel->diags.len == serial->diags.len);
+    for (size_t i = 0; i < serial->diags.len; i++) {
+        ASSERT(parallel->diags.list[i].span.offset ==
+               serial->diags.list[i].span.offset);
+    }
+    ASSERT(parallel->lexed == len);
+    ASSERT(parallel->len == serial->len);
+    for (size_t i = 0; i <= serial->len; i++) {
+        ASSERT(parallel->offsets[i] == serial->offsets[i]);
+    }
+
+    tokens_free(parallel);
+    tokens_free(serial);
+    ident_table_free(idents);
+    free(prog);
+}
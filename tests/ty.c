@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "ident.h"
+#include "parser.h"
+#include "ty.h"
+#include "tycheck.h"
+
+#include "framework.h"
+
+// The same type is always the same struct ty.
+TEST(ty_interned) {
+    struct ty_table *types = ty_table_new();
+
+    struct ty *i = ty_basic(types, BasicTy_Int);
+    struct ty *l = ty_basic(types, BasicTy_LongInt);
+    ASSERT(ty_basic(types, BasicTy_Int) == i);
+    ASSERT(ty_compatible(i, ty_basic(types, BasicTy_Int)));
+    ASSERT(!ty_compatible(i, l));
+
+    struct ty *pi = ty_pointer(types, i);
+    ASSERT(pi->kind == Ty_Pointer && pi->inner == i);
+    ASSERT(ty_pointer(types, i) == pi);
+    ASSERT(ty_pointer(types, ty_pointer(types, i)) == ty_pointer(types, pi));
+    ASSERT(ty_pointer(types, l) != pi);
+    ASSERT(ty_pointer(types, pi) != pi);
+
+    // Structs with the same members are still different types.
+    struct ty *a = ty_struct_union(types, Ty_Struct, NULL);
+    struct ty *b = ty_struct_union(types, Ty_Struct, NULL);
+    ASSERT(a != b && a->nmembers == 0);
+    ASSERT(ty_pointer(types, a) != ty_pointer(types, b));
+
+    ty_table_free(types);
+}
+
+// Declarators of the same type are annotated with the same struct ty,
+// whichever function and scope they're in.
+TEST(tycheck_interned) {
+    static const char *prog = "int f() {\n"
+                              "    int *a;\n"
+                              "    struct s { int *x; long **y; } b;\n"
+                              "    { long **c; }\n"
+                              "    return 0;\n"
+                              "}\n"
+                              "int g() {\n"
+                              "    int *d;\n"
+                              "    struct s { int *x; long **y; } e;\n"
+                              "    return 0;\n"
+                              "}\n";
+
+    struct ident_table *idents = ident_table_new();
+    ast_program_t program;
+    parse_result_t result =
+        parser_parse(idents, prog, strlen(prog), &program);
+    ASSERT(result.kind == Parse_Result_Ok);
+
+    struct ty_table *types = ty_table_new();
+    struct tycheck *tyc = tycheck_new(types);
+    tycheck_check(tyc, &program);
+    tycheck_free(tyc);
+
+    ast_function_t *f = program.ordered[0];
+    ast_function_t *g = program.ordered[1];
+    struct ty *a = f->block.items[0].decl.declarators[0].ty;
+    struct ty *b = f->block.items[1].decl.declarators[0].ty;
+    ast_statement_t *inner = &f->nodes.stmts[f->block.items[2].stmt];
+    ast_block_t *block = &f->nodes.blocks[inner->block];
+    struct ty *c = block->items[0].decl.declarators[0].ty;
+    struct ty *d = g->block.items[0].decl.declarators[0].ty;
+    struct ty *e = g->block.items[1].decl.declarators[0].ty;
+
+    ASSERT(a == ty_pointer(types, ty_basic(types, BasicTy_Int)));
+    ASSERT(a == d);
+    ASSERT(b->members[0].ty == a);
+    ASSERT(b->members[1].ty == c);
+    ASSERT(b != e && e->members[1].ty == c);
+
+    ty_table_free(types);
+    ast_program_free(&program);
+    ident_table_free(idents);
+}
@@ -0,0 +1,272 @@
+// Generates the lexer's tables: a DFA which recognises a single token
+// (including keywords and punctuators) per run, and the character classes
+// that its transitions are indexed by.
+//
+// Usage: lexgen > lexer_tables.h
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_STATES 256
+#define NUM_BYTES 256
+
+// State 0 is the dead state: there are no transitions out of it, and a
+// transition into it ends the token.
+#define DEAD 0
+#define START 1
+// Where an identifier goes once it can no longer be a keyword. It only loops
+// back to itself, so the lexer hands the rest of the run to a scan kernel.
+#define IDENT 2
+
+// How a run that ends in a state is turned into a token. Names are emitted
+// verbatim into the generated header.
+enum accept {
+    Accept_None,
+    Accept_Whitespace,
+    Accept_Identifier,
+    Accept_Constant,
+    Accept_Keyword,
+    Accept_Punctuator,
+    Accept_LineComment,
+    Accept_BlockComment,
+};
+
+static const char *accept_names[] = {
+    [Accept_None] = "Lex_None",
+    [Accept_Whitespace] = "Lex_Whitespace",
+    [Accept_Identifier] = "Lex_Identifier",
+    [Accept_Constant] = "Lex_Constant",
+    [Accept_Keyword] = "Lex_Keyword",
+    [Accept_Punctuator] = "Lex_Punctuator",
+    [Accept_LineComment] = "Lex_LineComment",
+    [Accept_BlockComment] = "Lex_BlockComment",
+};
+
+static const struct {
+    const char *str;
+    const char *name;
+} keywords[] = {
+    {"char", "Keyword_char"},     {"short", "Keyword_short"},
+    {"int", "Keyword_int"},       {"long", "Keyword_long"},
+    {"return", "Keyword_return"}, {"if", "Keyword_if"},
+    {"else", "Keyword_else"},     {"struct", "Keyword_struct"},
+    {"union", "Keyword_union"},   {"const", "Keyword_const"},
+};
+
+static const struct {
+    const char *str;
+    const char *name;
+} punctuators[] = {
+    {".", "Punctuator_Period"},
+    {"->", "Punctuator_Arrow"},
+    {";", "Punctuator_Semicolon"},
+    {",", "Punctuator_Comma"},
+    {"&", "Punctuator_Ampersand"},
+    {"=", "Punctuator_Assign"},
+    {"+=", "Punctuator_PlusAssign"},
+    {"-=", "Punctuator_MinusAssign"},
+    {"*=", "Punctuator_AsteriskAssign"},
+    {"/=", "Punctuator_ForwardSlashAssign"},
+    {"==", "Punctuator_Equal"},
+    {"!=", "Punctuator_NotEqual"},
+    {">", "Punctuator_GreaterThan"},
+    {">=", "Punctuator_GreaterThanEqual"},
+    {"<", "Punctuator_LessThan"},
+    {"<=", "Punctuator_LessThanEqual"},
+    {"+", "Punctuator_Plus"},
+    {"-", "Punctuator_Minus"},
+    {"*", "Punctuator_Asterisk"},
+    {"/", "Punctuator_ForwardSlash"},
+    {"(", "Punctuator_OpenParen"},
+    {")", "Punctuator_CloseParen"},
+    {"{", "Punctuator_OpenBrace"},
+    {"}", "Punctuator_CloseBrace"},
+    {"[", "Punctuator_OpenBracket"},
+    {"]", "Punctuator_CloseBracket"},
+};
+
+#define LEN(array) (sizeof(array) / sizeof(array[0]))
+
+static struct {
+    unsigned char next[MAX_STATES][NUM_BYTES];
+    enum accept accept[MAX_STATES];
+    // Name of the keyword or punctuator, for Accept_Keyword and
+    // Accept_Punctuator.
+    const char *value[MAX_STATES];
+    size_t nstates;
+} dfa;
+
+// Deliberately not using <ctype.h>: the classes mustn't depend on the locale.
+static bool is_digit(int c) { return c >= '0' && c <= '9'; }
+static bool is_nondigit(int c) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+static bool is_whitespace(int c) { return c == ' ' || c == '\t' || c == '\n'; }
+
+static size_t new_state(enum accept accept) {
+    if (dfa.nstates == MAX_STATES) {
+        fprintf(stderr, "lexgen: too many states\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t s = dfa.nstates++;
+    dfa.accept[s] = accept;
+    return s;
+}
+
+// Adds a literal token to the DFA, sharing states with any literal that has a
+// common prefix. Literals that look like identifiers branch off the
+// identifier state, so that (for example) "in" and "intx" still lex as
+// identifiers.
+static void add_literal(const char *str, enum accept accept,
+                        const char *value, size_t ident) {
+    size_t s = START;
+    for (const char *c = str; *c; c++) {
+        unsigned char byte = *c;
+        size_t next = dfa.next[s][byte];
+
+        if (next == DEAD || next == ident) {
+            bool in_ident = (next == ident);
+            next = new_state(in_ident ? Accept_Identifier : Accept_None);
+            if (in_ident) {
+                memcpy(dfa.next[next], dfa.next[ident], NUM_BYTES);
+            }
+            dfa.next[s][byte] = next;
+        }
+
+        s = next;
+    }
+
+    dfa.accept[s] = accept;
+    dfa.value[s] = value;
+}
+
+static void build(void) {
+    new_state(Accept_None);       // DEAD
+    new_state(Accept_None);       // START
+    new_state(Accept_Identifier); // IDENT
+
+    size_t whitespace = new_state(Accept_Whitespace);
+    size_t constant = new_state(Accept_Constant);
+    size_t ident = IDENT;
+
+    for (int c = 0; c < NUM_BYTES; c++) {
+        if (is_whitespace(c)) {
+            dfa.next[START][c] = whitespace;
+            dfa.next[whitespace][c] = whitespace;
+        }
+        if (is_digit(c)) {
+            dfa.next[START][c] = constant;
+            dfa.next[constant][c] = constant;
+        }
+        if (is_nondigit(c)) {
+            dfa.next[START][c] = ident;
+        }
+        if (is_nondigit(c) || is_digit(c)) {
+            dfa.next[ident][c] = ident;
+        }
+    }
+
+    for (size_t i = 0; i < LEN(keywords); i++) {
+        add_literal(keywords[i].str, Accept_Keyword, keywords[i].name, ident);
+    }
+    for (size_t i = 0; i < LEN(punctuators); i++) {
+        add_literal(punctuators[i].str, Accept_Punctuator,
+                    punctuators[i].name, ident);
+    }
+
+    // Only the start of a comment is recognised: the lexer skips the rest.
+    add_literal("//", Accept_LineComment, NULL, ident);
+    add_literal("/*", Accept_BlockComment, NULL, ident);
+}
+
+// Bytes which every state treats identically share a character class, so
+// the transition table only needs a column per class.
+static size_t classify(unsigned char classes[NUM_BYTES],
+                       int representatives[NUM_BYTES]) {
+    size_t nclasses = 0;
+    for (int c = 0; c < NUM_BYTES; c++) {
+        size_t k = 0;
+        for (; k < nclasses; k++) {
+            int r = representatives[k];
+            bool same = true;
+            for (size_t s = 0; s < dfa.nstates && same; s++) {
+                same = dfa.next[s][c] == dfa.next[s][r];
+            }
+            if (same) {
+                break;
+            }
+        }
+        if (k == nclasses) {
+            representatives[nclasses++] = c;
+        }
+        classes[c] = k;
+    }
+    return nclasses;
+}
+
+int main(void) {
+    build();
+
+    unsigned char classes[NUM_BYTES];
+    int representatives[NUM_BYTES];
+    size_t nclasses = classify(classes, representatives);
+
+    printf("// Generated by tools/lexgen.c. Do not edit.\n\n");
+    printf("#pragma once\n\n");
+    printf("#include <stdint.h>\n\n");
+
+    printf("enum lex_accept {\n");
+    for (size_t i = 0; i < LEN(accept_names); i++) {
+        printf("    %s,\n", accept_names[i]);
+    }
+    printf("};\n\n");
+
+    printf("#define LEX_DEAD %d\n", DEAD);
+    printf("#define LEX_START %d\n", START);
+    printf("#define LEX_IDENT %d\n", IDENT);
+    printf("#define LEX_STATES %zu\n", dfa.nstates);
+    printf("#define LEX_CLASSES %zu\n\n", nclasses);
+
+    printf("static const uint8_t lex_class[256] = {");
+    for (int c = 0; c < NUM_BYTES; c++) {
+        printf("%s%d,", c % 16 ? " " : "\n    ", classes[c]);
+    }
+    printf("\n};\n\n");
+
+    printf("static const uint8_t lex_next[LEX_STATES][LEX_CLASSES] = {\n");
+    for (size_t s = 0; s < dfa.nstates; s++) {
+        printf("    {");
+        for (size_t k = 0; k < nclasses; k++) {
+            printf("%s%d", k ? ", " : "", dfa.next[s][representatives[k]]);
+        }
+        printf("},\n");
+    }
+    printf("};\n\n");
+
+    printf("static const struct {\n");
+    printf("    uint8_t kind;  // enum lex_accept\n");
+    printf("    uint8_t value; // token_keyword_t or token_punctuator_t\n");
+    printf("} lex_accept[LEX_STATES] = {\n");
+    for (size_t s = 0; s < dfa.nstates; s++) {
+        printf("    {%s, %s},\n", accept_names[dfa.accept[s]],
+               dfa.value[s] ? dfa.value[s] : "0");
+    }
+    printf("};\n\n");
+
+    printf("static const char *lex_keyword_names[] = {\n");
+    for (size_t i = 0; i < LEN(keywords); i++) {
+        printf("    [%s] = \"%s\",\n", keywords[i].name, keywords[i].str);
+    }
+    printf("};\n\n");
+
+    printf("static const char *lex_punctuator_names[] = {\n");
+    for (size_t i = 0; i < LEN(punctuators); i++) {
+        printf("    [%s] = \"%s\",\n", punctuators[i].name,
+               punctuators[i].str);
+    }
+    printf("};\n");
+
+    return EXIT_SUCCESS;
+}